@@ -0,0 +1,52 @@
+// Measure malloc and free.
+//   allocbench [n [maxsize]]
+// Keeps NLIVE blocks allocated, replacing a random one n times
+// (default 100000) with a new block of 1 to maxsize bytes
+// (default 256), then prints the rate.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "date.h"
+
+#define NLIVE 1024
+
+char *live[NLIVE];
+
+int
+main(int argc, char *argv[])
+{
+  int n, max, i, j;
+  uint seed, ms;
+  struct timespec t0, t1;
+
+  n = argc > 1 ? atoi(argv[1]) : 100000;
+  max = argc > 2 ? atoi(argv[2]) : 256;
+  if(n <= 0 || max <= 0){
+    printf(2, "usage: allocbench [n [maxsize]]\n");
+    exit();
+  }
+
+  seed = 1;
+  clocknow(CLOCK_MONOTONIC, &t0);
+  for(i = 0; i < n; i++){
+    seed = seed * 1103515245 + 12345;
+    j = (seed >> 16) % NLIVE;
+    free(live[j]);
+    if((live[j] = malloc(1 + (seed >> 4) % max)) == 0){
+      printf(2, "allocbench: out of memory\n");
+      exit();
+    }
+    live[j][0] = i;
+  }
+  for(j = 0; j < NLIVE; j++)
+    free(live[j]);
+  clocknow(CLOCK_MONOTONIC, &t1);
+
+  ms = (t1.sec - t0.sec) * 1000 + (t1.nsec / 1000000) - (t0.nsec / 1000000);
+  if(ms == 0)
+    ms = 1;
+  printf(1, "%d mallocs of 1-%d bytes in %d ms: %d per ms\n", n, max, ms,
+    n / ms);
+  exit();
+}
@@ -105,6 +105,45 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Read block blockno of dev into dst, a kernel address, without
+// caching it.  The block comes straight from the disk, unless the
+// cache holds it, maybe newer than the disk, in which case it is
+// copied from there.  Returns -1 if out of memory.
+int
+bdirect(uint dev, uint blockno, uchar *dst)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      if((b->flags & B_VALID) == 0)
+        iderw(b);
+      memmove(dst, b->data, BSIZE);
+      brelse(b);
+      return 0;
+    }
+  }
+  release(&bcache.lock);
+
+  // A private buf, for iderw to transfer into dst.
+  if((b = (struct buf*)kalloc()) == 0)
+    return -1;
+  memset(b, 0, sizeof(*b));
+  initsleeplock(&b->lock, "direct");
+  b->dev = dev;
+  b->blockno = blockno;
+  b->addr = dst;
+  acquiresleep(&b->lock);
+  iderw(b);
+  releasesleep(&b->lock);
+  kfree((char*)b);
+  return 0;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
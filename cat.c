@@ -1,8 +1,16 @@
+// Concatenate files to standard output.
+//   cat [-j n] [file ...]
+// With -j and more than one file, n forked workers read the
+// files at once, and their output is copied out in file order
+// (see forkeach in ulib.c).
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 
-char buf[512];
+#define CHUNK (64*1024)
+
+char buf[CHUNK];
 
 void
 cat(int fd)
@@ -11,33 +19,54 @@ cat(int fd)
 
   while((n = read(fd, buf, sizeof(buf))) > 0) {
     if (write(1, buf, n) != n) {
-      printf(1, "cat: write error\n");
+      printf(2, "cat: write error\n");
       exit();
     }
   }
   if(n < 0){
-    printf(1, "cat: read error\n");
+    printf(2, "cat: read error\n");
     exit();
   }
 }
 
+int
+catfile(char *name)
+{
+  int fd;
+
+  if((fd = open(name, 0)) < 0){
+    printf(2, "cat: cannot open %s\n", name);
+    return -1;
+  }
+  cat(fd);
+  close(fd);
+  return 0;
+}
+
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int i, njob;
+
+  njob = 1;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-j") == 0){
+    njob = atoi(argv[2]);
+    i = 3;
+  }
 
-  if(argc <= 1){
+  if(i >= argc){
     cat(0);
     exit();
   }
+  if(argc - i > 1 && njob > 1){
+    if(forkeach(argv + i, argc - i, njob, catfile) < 0)
+      printf(2, "cat: cannot start worker\n");
+    exit();
+  }
 
-  for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf(1, "cat: cannot open %s\n", argv[i]);
+  for(; i < argc; i++)
+    if(catfile(argv[i]) < 0)
       exit();
-    }
-    cat(fd);
-    close(fd);
-  }
   exit();
 }
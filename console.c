@@ -14,6 +14,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "poll.h"
 
 static void consputc(int);
 
@@ -184,6 +185,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct waitq wq;  // Pollers waiting for a line
 } input;
 
 #define C(x)  ((x)-'@')  // Control-x
@@ -191,7 +193,7 @@ struct {
 void
 consoleintr(int (*getc)(void))
 {
-  int c, doprocdump = 0;
+  int c, doprocdump = 0, dolockdump = 0;
 
   acquire(&cons.lock);
   while((c = getc()) >= 0){
@@ -200,6 +202,9 @@ consoleintr(int (*getc)(void))
       // procdump() locks cons.lock indirectly; invoke later
       doprocdump = 1;
       break;
+    case C('L'):  // Lock statistics.
+      dolockdump = 1;
+      break;
     case C('U'):  // Kill line.
       while(input.e != input.w &&
             input.buf[(input.e-1) % INPUT_BUF] != '\n'){
@@ -221,6 +226,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          pollwakeup(&input.wq);
         }
       }
       break;
@@ -230,6 +236,8 @@ consoleintr(int (*getc)(void))
   if(doprocdump) {
     procdump();  // now call procdump() wo. cons.lock held
   }
+  if(dolockdump)
+    lockdump();
 }
 
 int
@@ -270,6 +278,20 @@ consoleread(struct inode *ip, char *dst, int n)
   return target - n;
 }
 
+int
+consolepoll(struct inode *ip, struct poller *pw)
+{
+  int r;
+
+  acquire(&cons.lock);
+  pollwait(&input.wq, pw);
+  r = POLLOUT;
+  if(input.r != input.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
@@ -292,6 +314,8 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
+  input.wq.lock = &cons.lock;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
@@ -6,3 +6,27 @@ struct rtcdate {
   uint month;
   uint year;
 };
+
+struct timespec {
+  uint sec;
+  uint nsec;
+};
+
+#define CLOCK_REALTIME   0  // seconds since 1970
+#define CLOCK_MONOTONIC  1  // seconds since boot
+
+// Clock data that the kernel maps read-only into every process
+// at CLOCKPAGE, so that programs can tell the time without a
+// system call.  Nanoseconds since boot are
+//   ((rdtsc() - tsc0) * mult) >> shift
+// where the product is formed in 32-bit halves (see clocknow()
+// in ulib.c).  The page also tells the system call stubs in
+// usys.S whether they can use sysenter, at SYSENTEROK.
+struct clockdata {
+  uint64 tsc0;           // TSC at boot
+  uint mult;             // TSC cycles to nanoseconds:
+  uint shift;            //   multiply, then shift right
+  uint boottime;         // CLOCK_REALTIME seconds at boot
+  volatile uint ticks;   // Copy of the kernel's ticks
+  uint sysenter;         // Non-zero if sysenter works
+};
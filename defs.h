@@ -1,20 +1,33 @@
 struct buf;
 struct context;
+struct fdtable;
 struct file;
 struct inode;
+struct iovec;
+struct lockclass;
+struct lockstat;
+struct mm;
+struct page;
 struct pipe;
+struct poller;
+struct pollfd;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct timespec;
+struct vma;
+struct waitq;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             bdirect(uint, uint, uchar*);
 
 // console.c
 void            consoleinit(void);
@@ -26,13 +39,23 @@ void            panic(char*) __attribute__((noreturn));
 int             exec(char*, char**);
 
 // file.c
+struct fdtable* fdtalloc(void);
+struct fdtable* fdtcopy(struct fdtable*);
+struct fdtable* fdtdup(struct fdtable*);
+struct file*    fdget(int);
+void            fdtput(struct fdtable*);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+int             filegetdents(struct file*, char*, int);
 void            fileinit(void);
+int             filepoll(struct file*, struct poller*);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
+int             filesplice(struct file*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -48,11 +71,19 @@ void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
+struct inode*   nameiat(struct inode*, char*);
+int             readdirect(struct inode*, char*, uint, uint);
 struct inode*   nameiparent(char*, char*);
+int             readblocks(struct inode*, char*, uint, uint);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -68,6 +99,8 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             krefs(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -77,7 +110,11 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicidle(uint);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
+uint            lapicresume(void);
+uint            lapictsc(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -95,32 +132,61 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+int             pagecached(struct inode*, uint);
+struct page*    pageget(struct inode*, uint);
+void            pageinit(void);
+void            pageinval(struct inode*);
+void            pageput(struct page*);
+int             pageread(struct inode*, char*, uint, uint);
+void            pagewrite(struct inode*, char*, uint, uint);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+int             pipeavail(struct pipe*);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             pipepoll(struct pipe*, int, struct poller*);
+int             piperead(struct pipe*, char*, int, int);
+int             pipesize(struct pipe*, int);
+int             pipewait(struct pipe*);
+int             pipewrite(struct pipe*, char*, int, int);
+
+// poll.c
+int             poll(struct pollfd*, int, int);
+void            pollwait(struct waitq*, struct poller*);
+void            pollwakeup(struct waitq*);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint, uint);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             join(uint*);
 int             kill(int);
+int             killthreads(void);
+int             mmlock(struct mm*, uint, uint);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+void            pin(struct proc*, uint, uint);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+void            unpin(struct proc*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
+// ring.c
+int             ringenter(int);
+int             ringsetup(uint);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -129,6 +195,12 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            lockacquired(struct lockclass*, int, uint, uint64, uint);
+struct lockclass* lockclass(char*);
+void            lockdump(void);
+int             lockprof(int);
+void            lockreleased(struct lockclass*, int, uint64);
+int             lockstats(struct lockstat*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -150,17 +222,32 @@ char*           strncpy(char*, const char*, int);
 
 // syscall.c
 int             argint(int, int*);
+int             argout(int, char**, int);
 int             argptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
+// sysfile.c
+int             fdclose(int);
+int             fileopen(char*, int);
+
 // timer.c
+int             clockread(int, struct timespec*);
+int             nsleep(uint, uint);
+void            timeradd(struct timer*, uint);
+void            timerdel(struct timer*);
+void            timerexpire(void);
 void            timerinit(void);
+uint            timernext(void);
+int             timersleep(uint);
+extern uint     tscpertick;
 
 // trap.c
 void            idtinit(void);
+void            tickskip(uint);
+extern int      sysenterok;
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
@@ -175,16 +262,29 @@ void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
+char*           uva2kaw(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+struct mm*      mmalloc(pde_t*);
+struct mm*      mmcopy(struct mm*);
+struct mm*      mmdup(struct mm*);
+void            mminit(void);
+void            mmput(struct mm*);
+int             pagefault(struct proc*, uint, int);
+void            tlbflush(struct mm*);
+int             uvmtouch(struct proc*, uint, uint, int);
+void            vmafree(struct vma*, int);
+struct vma*     vmalookup(struct mm*, uint);
+int             vmamap(struct mm*, struct inode*, uint, uint, int);
+struct vma*     vmaoverlap(struct mm*, uint, uint);
+int             vmaunmap(struct mm*, uint, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
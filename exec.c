@@ -6,17 +6,22 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
 
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nvma;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  struct vma vma[NVMA], *v;
+  pde_t *pgdir;
+  struct mm *mm, *oldmm;
   struct proc *curproc = myproc();
 
   begin_op();
@@ -28,6 +33,8 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  memset(vma, 0, sizeof(vma));
+  nvma = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,7 +45,9 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Map the program's segments.  Their pages are read from
+  // the file when the program first touches them, so the
+  // segments must be page aligned in the file, and in order.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -47,14 +56,29 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > USERTOP)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr % PGSIZE != ph.off % PGSIZE || ph.vaddr < sz)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.memsz == 0)
+      continue;
+    if(nvma == NVMA)
       goto bad;
+    v = &vma[nvma++];
+    v->start = PGROUNDDOWN(ph.vaddr);
+    v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+    v->off = ph.off - (ph.vaddr - v->start);
+    // Map whole pages of file content, unless the tail of
+    // the segment must be zero (bss).
+    if(ph.filesz == ph.memsz)
+      v->filesz = v->end - v->start;
+    else
+      v->filesz = ph.vaddr - v->start + ph.filesz;
+    v->flags = 0;
+    if(ph.flags & ELF_PROG_FLAG_WRITE)
+      v->flags |= VMA_WRITE;
+    v->ip = idup(ip);
+    sz = v->end;
   }
   iunlockput(ip);
   end_op();
@@ -62,7 +86,6 @@ exec(char *path, char **argv)
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
-  sz = PGROUNDUP(sz);
   if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
@@ -87,20 +110,26 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
+  if(killthreads() < 0 || (mm = mmalloc(pgdir)) == 0)
+    goto bad;
+
   // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  // Commit to the user image, which no other thread shares.
+  mm->sz = sz;
+  memmove(mm->vma, vma, sizeof(vma));
+  unpin(curproc);
+  curproc->ring = 0;
+  oldmm = curproc->mm;
+  curproc->mm = mm;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  mmput(oldmm);
   return 0;
 
  bad:
@@ -108,6 +137,11 @@ exec(char *path, char **argv)
     freevm(pgdir);
   if(ip){
     iunlockput(ip);
+    vmafree(vma, nvma);
+    end_op();
+  } else {
+    begin_op();
+    vmafree(vma, nvma);
     end_op();
   }
   return -1;
@@ -2,3 +2,15 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x800  // Fail with EAGAIN instead of waiting
+#define O_DIRECT  0x4000  // Read from the disk around the caches
+
+// Returned by read and write on an O_NONBLOCK file
+// that would have to wait.
+#define EAGAIN    (-2)
+
+// fcntl commands
+#define F_GETPIPE_SZ  1  // Size of a pipe's buffer
+#define F_SETPIPE_SZ  2  // Resize a pipe's buffer, up to 64KB
+#define F_GETFL       3  // Open mode and flags
+#define F_SETFL       4  // Set flags; O_NONBLOCK and O_DIRECT can change
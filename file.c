@@ -5,10 +5,17 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "page.h"
+#include "poll.h"
+#include "fcntl.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -16,10 +23,20 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+struct {
+  struct spinlock lock;
+  struct fdtable fdt[NPROC];
+} fdtables;
+
 void
 fileinit(void)
 {
+  struct fdtable *t;
+
   initlock(&ftable.lock, "ftable");
+  initlock(&fdtables.lock, "fdtables");
+  for(t = fdtables.fdt; t < &fdtables.fdt[NPROC]; t++)
+    initlock(&t->lock, "fdtable");
 }
 
 // Allocate a file structure.
@@ -79,6 +96,125 @@ fileclose(struct file *f)
   }
 }
 
+//PAGEBREAK!
+// Allocate an empty file descriptor table.
+struct fdtable*
+fdtalloc(void)
+{
+  struct fdtable *t;
+
+  acquire(&fdtables.lock);
+  for(t = fdtables.fdt; t < &fdtables.fdt[NPROC]; t++){
+    if(t->ref == 0){
+      t->ref = 1;
+      memset(t->ofile, 0, sizeof(t->ofile));
+      release(&fdtables.lock);
+      return t;
+    }
+  }
+  release(&fdtables.lock);
+  return 0;
+}
+
+// Allocate a table with the same open files as t, for fork.
+struct fdtable*
+fdtcopy(struct fdtable *t)
+{
+  struct fdtable *nt;
+  int fd;
+
+  if((nt = fdtalloc()) == 0)
+    return 0;
+  acquire(&t->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(t->ofile[fd])
+      nt->ofile[fd] = filedup(t->ofile[fd]);
+  release(&t->lock);
+  return nt;
+}
+
+// Increment ref count for table t, for a new thread.
+struct fdtable*
+fdtdup(struct fdtable *t)
+{
+  acquire(&fdtables.lock);
+  t->ref++;
+  release(&fdtables.lock);
+  return t;
+}
+
+// Drop a thread's reference to t.  The last one
+// closes all the files.
+void
+fdtput(struct fdtable *t)
+{
+  int fd;
+
+  acquire(&fdtables.lock);
+  if(t->ref > 1){
+    t->ref--;
+    release(&fdtables.lock);
+    return;
+  }
+  release(&fdtables.lock);
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if(t->ofile[fd]){
+      fileclose(t->ofile[fd]);
+      t->ofile[fd] = 0;
+    }
+  }
+  acquire(&fdtables.lock);
+  t->ref = 0;
+  release(&fdtables.lock);
+}
+
+// Return a new reference to the file open as fd in the
+// current process, or 0 if there is none.
+struct file*
+fdget(int fd)
+{
+  struct fdtable *t = myproc()->fdt;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&t->lock);
+  if((f = t->ofile[fd]) != 0)
+    filedup(f);
+  release(&t->lock);
+  return f;
+}
+
+// Copy as many of directory f's entries as fit into the n
+// bytes at addr, skipping empty slots, and advance f's offset
+// past them.  Returns the number of bytes copied, 0 at the end
+// of the directory, or -1.
+int
+filegetdents(struct file *f, char *addr, int n)
+{
+  struct dirent de;
+  int tot;
+
+  if(f->type != FD_INODE || f->readable == 0 || n < sizeof(de))
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_DIR){
+    iunlock(f->ip);
+    return -1;
+  }
+  for(tot = 0; tot + sizeof(de) <= n && f->off < f->ip->size; f->off += sizeof(de)){
+    if(readi(f->ip, (char*)&de, f->off, sizeof(de)) != sizeof(de))
+      panic("filegetdents");
+    if(de.inum == 0)
+      continue;
+    memmove(addr + tot, &de, sizeof(de));
+    tot += sizeof(de);
+  }
+  iunlock(f->ip);
+  return tot;
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)
@@ -92,22 +228,91 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Return which of POLLIN, POLLOUT, POLLERR and POLLHUP hold
+// for f.  If pw is not 0, also arrange for it to be woken when
+// that may have changed (see poll.c).  Inodes other than devices
+// that can poll are always ready.
+int
+filepoll(struct file *f, struct poller *pw)
+{
+  struct inode *ip;
+  int r;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, pw);
+  if(f->type != FD_INODE)
+    panic("filepoll");
+  ip = f->ip;
+  r = POLLIN | POLLOUT;
+  if(ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+     devsw[ip->major].poll)
+    r = devsw[ip->major].poll(ip, pw);
+  return r & ((f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0));
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1, -1);
+}
+
+// Read from file f into the n buffers of iov in turn, starting
+// at offset off, or at f's offset if off is negative, and then
+// advance f's offset.  An inode stays locked for the whole
+// read.  Returns the number of bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int n, int off)
+{
+  int i, r, tot;
+  uint o;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  tot = 0;
+  if(f->type == FD_PIPE){
+    if(off >= 0)
+      return -1;
+    // Wait for the first buffer only, as read would.
+    for(i = 0; i < n; i++){
+      r = piperead(f->pipe, iov[i].base, iov[i].len, f->nonblock || tot > 0);
+      if(r < 0)
+        return tot > 0 ? tot : r;
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
+    // Devices read without the file's flags; ask first
+    // whether a read would wait.
+    if(f->nonblock && f->ip->type == T_DEV && !(filepoll(f, 0) & POLLIN))
+      return EAGAIN;
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    o = off < 0 ? f->off : off;
+    for(i = 0; i < n; i++){
+      if(f->direct)
+        r = readdirect(f->ip, iov[i].base, o + tot, iov[i].len);
+      else
+        r = readi(f->ip, iov[i].base, o + tot, iov[i].len);
+      if(r < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    if(off < 0 && tot > 0)
+      f->off += tot;
     iunlock(f->ip);
-    return r;
+    return tot;
   }
   panic("fileread");
 }
@@ -117,12 +322,38 @@ fileread(struct file *f, char *addr, int n)
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1, -1);
+}
+
+// Write the n buffers of iov to file f in turn, starting at
+// offset off, or at f's offset if off is negative, and then
+// advance f's offset.  Returns the number of bytes written,
+// or -1.
+int
+filewritev(struct file *f, struct iovec *iov, int n, int off)
+{
+  int i, r, tot, skip, m, n1;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  tot = 0;
+  if(f->type == FD_PIPE){
+    if(off >= 0)
+      return -1;
+    for(i = 0; i < n; i++){
+      r = pipewrite(f->pipe, iov[i].base, iov[i].len, f->nonblock);
+      if(r < 0)
+        return tot > 0 ? tot : r;
+      tot += r;
+      if(r < iov[i].len)
+        break;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -130,28 +361,137 @@ filewrite(struct file *f, char *addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
+    // Each transaction takes as much of the buffers as fits,
+    // with one hold of the inode lock.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+    uint o;
 
+    i = 0;
+    skip = 0;  // bytes of iov[i] already written
+    r = 0;
+    while(i < n && r >= 0){
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      o = off < 0 ? f->off : off + tot;
+      for(m = 0; i < n && m < max; m += r){
+        n1 = iov[i].len - skip;
+        if(n1 > max - m)
+          n1 = max - m;
+        if((r = writei(f->ip, (char*)iov[i].base + skip, o + m, n1)) < 0)
+          break;
+        if(r != n1)
+          panic("short filewrite");
+        skip += r;
+        if(skip == iov[i].len){
+          i++;
+          skip = 0;
+        }
+      }
+      if(off < 0)
+        f->off += m;
       iunlock(f->ip);
       end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      tot += m;
     }
-    return i == n ? n : -1;
+    return i == n ? tot : -1;
   }
   panic("filewrite");
 }
 
+
+#define NOPAGE (-3)  // pagesplice found no page to spare
+
+// Write the next n bytes of regular file f, at most the rest
+// of a page, into pipe p straight from the page cache.  The
+// pipe is written without waiting while f's inode is locked,
+// so that the offset moves with the bytes written; when the
+// pipe is full the lock is dropped to wait for room.  Returns
+// the number of bytes written, 0 at the end of the file, -1,
+// or NOPAGE if every page in the cache is in use.
+static int
+pagesplice(struct file *f, struct pipe *p, int n)
+{
+  struct page *pg;
+  uint off;
+  int r;
+
+  for(;;){
+    ilock(f->ip);
+    off = f->off;
+    if(off >= f->ip->size){
+      iunlock(f->ip);
+      return 0;
+    }
+    if(n > f->ip->size - off)
+      n = f->ip->size - off;
+    if(n > PGSIZE - off%PGSIZE)
+      n = PGSIZE - off%PGSIZE;
+    if((pg = pageget(f->ip, PGROUNDDOWN(off))) == 0){
+      iunlock(f->ip);
+      return NOPAGE;
+    }
+    r = pipewrite(p, pg->data + off%PGSIZE, n, 1);
+    pageput(pg);
+    if(r > 0)
+      f->off += r;
+    iunlock(f->ip);
+    if(r != EAGAIN)
+      return r;
+    if(pipewait(p) < 0)
+      return -1;
+  }
+}
+
+// Write all n bytes of addr to f, even if f is O_NONBLOCK.
+static int
+splicewrite(struct file *f, char *addr, int n)
+{
+  if(f->type == FD_PIPE)
+    return pipewrite(f->pipe, addr, n, 0);
+  return filewrite(f, addr, n);
+}
+
+// Move up to n bytes from file in to file out inside the
+// kernel, instead of through a user buffer.  Regular files go
+// into pipes straight from the page cache; anything else is
+// copied through one kernel page.  Like read, stops early
+// rather than wait for more than a pipe has.  O_NONBLOCK
+// counts only for in: once read, data is always written out.
+// Returns the number of bytes moved, 0 at the end of in,
+// EAGAIN, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  char *buf;
+  int total, m, r;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  buf = 0;
+  total = 0;
+  while(total < n){
+    m = n - total;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    r = NOPAGE;
+    if(in->type == FD_INODE && in->ip->type == T_FILE &&
+       out->type == FD_PIPE)
+      r = pagesplice(in, out->pipe, m);
+    if(r == NOPAGE){
+      if(buf == 0 && (buf = kalloc()) == 0)
+        r = -1;
+      else if((r = fileread(in, buf, m)) > 0 && splicewrite(out, buf, r) != r)
+        r = -1;
+    }
+    if(r < 0 && total == 0)
+      total = r;
+    if(r <= 0)
+      break;
+    total += r;
+    if(in->type == FD_PIPE && (r < m || pipeavail(in->pipe) == 0))
+      break;
+  }
+  if(buf)
+    kfree(buf);
+  return total;
+}
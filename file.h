@@ -1,13 +1,32 @@
+struct poller;
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock; // O_NONBLOCK
+  char direct;   // O_DIRECT
   struct pipe *pipe;
   struct inode *ip;
   uint off;
 };
 
+// A process's open files, indexed by file descriptor.
+// The threads of a process share one.
+struct fdtable {
+  struct spinlock lock;  // Protects ofile
+  int ref;               // Threads using it; protected by fdtables.lock
+  struct file *ofile[NOFILE];
+};
+
+
+// Processes in poll() waiting on a pipe or device (see poll.c).
+// lock is the object's own lock, which protects the list.
+struct waitq {
+  struct spinlock *lock;
+  struct pollent *head;
+};
 
 // in-memory copy of an inode
 struct inode {
@@ -30,6 +49,7 @@ struct inode {
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, struct poller*);  // may be 0
 };
 
 extern struct devsw devsw[];
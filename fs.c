@@ -13,10 +13,12 @@
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
+#include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "mm.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -433,6 +435,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pageinval(ip);
 }
 
 // Copy stat information from inode.
@@ -449,18 +452,72 @@ stati(struct inode *ip, struct stat *st)
 
 //PAGEBREAK!
 // Read data from inode.
+// Regular files are read through the page cache, so that
+// read() sees what processes have stored into pages mapped
+// with mmap().
 // Caller must hold ip->lock.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
-
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
     return devsw[ip->major].read(ip, dst, n);
   }
+  if(ip->type == T_FILE)
+    return pageread(ip, dst, off, n);
+  return readblocks(ip, dst, off, n);
+}
+
+// Read data from inode like readi, for an O_DIRECT file:
+// whole blocks that lie within the file and land block-aligned
+// in dst go straight from the disk into dst, around the page and
+// buffer caches; the rest goes through readi.  So do blocks of
+// pages the page cache holds, which may be newer than the disk,
+// and blocks for pages of dst that are shared, since writes
+// through the kernel's mapping would not mark them dirty.
+// dst may be memory of the current process, made present by
+// the caller.  Caller must hold ip->lock.
+int
+readdirect(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m;
+  char *ka;
+
+  if(ip->type != T_FILE)
+    return readi(ip, dst, off, n);
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    ka = 0;
+    if(off%BSIZE == 0 && (uint)dst%BSIZE == 0 && n - tot >= BSIZE &&
+       !pagecached(ip, PGROUNDDOWN(off))){
+      if((uint)dst >= KERNBASE)
+        ka = dst;
+      else if((ka = uva2kaw(myproc()->mm->pgdir, dst)) != 0)
+        ka += (uint)dst%PGSIZE;
+    }
+    m = BSIZE;
+    if(ka && bdirect(ip->dev, bmap(ip, off/BSIZE), (uchar*)ka) == 0)
+      continue;
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(readi(ip, dst, off, m) != m)
+      return -1;
+  }
+  return n;
+}
+
+// Read data from inode through the buffer cache.
+// This is how the page cache reads pages from a file.
+// Caller must hold ip->lock.
+int
+readblocks(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -503,6 +560,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  pagewrite(ip, src - n, off - n, n);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -618,19 +676,20 @@ skipelem(char *path, char *name)
   return path;
 }
 
-// Look up and return the inode for a path name.
+// Look up and return the inode for a path name, relative to
+// directory dp, or to the current directory if dp is 0.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *dp, char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = idup(dp ? dp : myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -661,11 +720,19 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, name);
+}
+
+// Like namei, but relative to directory dp.
+struct inode*
+nameiat(struct inode *dp, char *path)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, name);
 }
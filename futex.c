@@ -0,0 +1,83 @@
+// Futexes: sleeping until a word of user memory changes.
+//
+// A futex is named by the physical address of the word, so
+// that threads, and processes sharing a page through mmap,
+// meet on the same futex wherever each has the page mapped.
+// The kernel address of the word serves as the sleep channel.
+//
+// futexwait sleeps only if the word still holds the value the
+// caller last saw, checked under futexlock, and futexwake takes
+// the same lock, so that a wakeup sent after the caller's check
+// but before its sleep is not lost.  User code does the rest
+// (see mutex_lock in ulib.c): it calls in only when it has to
+// wait or has waiters to wake.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "mm.h"
+
+struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+  initlock(&futexlock, "futex");
+}
+
+// Return the kernel address of the word at user address addr
+// in the current process, or 0 if there is none.  The page is
+// pinned until the system call returns (see uvmtouch).
+static uint*
+futexword(uint addr)
+{
+  struct proc *p = myproc();
+  char *page;
+
+  if(addr % 4 != 0 || uvmtouch(p, addr, 4, 0) < 0)
+    return 0;
+  if((page = uva2ka(p->mm->pgdir, (char*)PGROUNDDOWN(addr))) == 0)
+    return 0;
+  return (uint*)(page + addr % PGSIZE);
+}
+
+// If the word at addr holds val, sleep until futexwake.
+// Returns 0 after sleeping, -1 if the word had changed
+// or the process was killed.
+int
+futexwait(uint addr, uint val)
+{
+  uint *w;
+
+  if((w = futexword(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  if(*w != val){
+    release(&futexlock);
+    return -1;
+  }
+  sleep(w, &futexlock);
+  release(&futexlock);
+  return myproc()->killed ? -1 : 0;
+}
+
+// Wake at most n processes waiting on the word at addr.
+// Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  uint *w;
+  int r;
+
+  if((w = futexword(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  r = wakeupn(w, n);
+  release(&futexlock);
+  return r;
+}
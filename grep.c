@@ -1,107 +1,341 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//   grep [-j n] [-e pattern]... [pattern] [file ...]
+// Prints the lines matching any of the patterns.  The patterns
+// are compiled together into a DFA, built as the input needs its
+// states, so each byte of input costs a table lookup.  A pattern
+// that starts with a literal string is found with Boyer-Moore-
+// Horspool before the DFA looks at the line.  Files are mapped
+// with mmap, or read in large chunks, and with more than one
+// file, up to n (default NWORKER) are searched at once by
+// forked workers, their output printed in file order.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "mman.h"
 
-char buf[1024];
-int match(char*, char*);
+#define NPOS    64        // Pattern positions, over all patterns
+#define NSTATE  128       // DFA states kept at once
+#define NWORKER 4         // Default number of workers
+#define CHUNK   (64*1024) // Read buffer size
 
-void
-grep(char *pattern, int fd)
+typedef uint64 set;       // A set of pattern positions
+#define BIT(i) ((set)1 << (i))
+
+// Each pattern occupies positions base..base+k for its k atoms;
+// being at position j means atoms before j have matched, and
+// base+k means the pattern has.
+uchar atomc[NPOS];        // Byte atom j matches, if not any
+char atomany[NPOS];       // Atom j is '.'
+char atomstar[NPOS];      // Atom j is followed by '*'
+int npos;
+set final;                // Ends of patterns
+set eolfinal;             // Ends of patterns that end in $
+set starts;               // Beginnings of unanchored patterns
+set linestarts;           // Beginnings of all patterns
+
+// The DFA.  State i is the set of positions dset[i];
+// dnext[i][c] is the state after byte c, or -1 if not yet known.
+set dset[NSTATE];
+short dnext[NSTATE][256];
+char dstop[NSTATE];       // 1 if matched, 2 if no match possible
+char deol[NSTATE];        // Matches if the line ends here
+int nstate;
+int dstart;               // State at the start of a line
+
+// A literal prefix every match starts with, for Horspool.
+char *lit;
+int nlit;
+int litskip[256];
+
+char buf[CHUNK];
+char *outp;               // Matched lines waiting to be written
+int outn;
+
+static void
+compile(char *re)
 {
-  int n, m;
-  char *p, *q;
+  int base, i;
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
+  if(npos == NPOS){
+    printf(2, "grep: patterns too long\n");
+    exit();
+  }
+  base = npos;
+  if(re[0] != '^')
+    starts |= BIT(base);
+  else
+    re++;
+  linestarts |= BIT(base);
+  for(i = 0; re[i]; ){
+    if(re[i] == '$' && re[i+1] == '\0'){
+      eolfinal |= BIT(npos++);
+      return;
     }
-    if(p == buf)
-      m = 0;
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+    if(npos == NPOS - 1){
+      printf(2, "grep: patterns too long\n");
+      exit();
     }
+    atomc[npos] = re[i];
+    atomany[npos] = re[i] == '.';
+    atomstar[npos] = re[i+1] == '*';
+    i += atomstar[npos] ? 2 : 1;
+    npos++;
   }
+  final |= BIT(npos++);
 }
 
-int
-main(int argc, char *argv[])
+// Horspool needs a single unanchored pattern;
+// its literal prefix is the atoms before any '.' or '*'.
+static void
+findliteral(char *re)
 {
-  int fd, i;
-  char *pattern;
+  int i;
 
-  if(argc <= 1){
-    printf(2, "usage: grep pattern [file ...]\n");
-    exit();
-  }
-  pattern = argv[1];
+  for(nlit = 0; re[nlit] && re[nlit] != '.'; nlit++)
+    if(re[nlit+1] == '*' || (re[nlit] == '$' && re[nlit+1] == '\0'))
+      break;
+  if(nlit == 0)
+    return;
+  lit = re;
+  for(i = 0; i < 256; i++)
+    litskip[i] = nlit;
+  for(i = 0; i < nlit - 1; i++)
+    litskip[(uchar)lit[i]] = nlit - 1 - i;
+}
 
-  if(argc <= 2){
-    grep(pattern, 0);
-    exit();
+// Add the positions reachable by skipping starred atoms.
+static set
+closure(set s)
+{
+  int j;
+
+  for(j = 0; j < npos; j++)
+    if((s & BIT(j)) && !((final | eolfinal) & BIT(j)) && atomstar[j])
+      s |= BIT(j+1);
+  return s;
+}
+
+static int
+addstate(set s)
+{
+  int i;
+
+  for(i = 0; i < nstate; i++)
+    if(dset[i] == s)
+      return i;
+  dset[i] = s;
+  memset(dnext[i], 0xff, sizeof(dnext[i]));
+  if(s & final)
+    dstop[i] = 1;
+  else if(s == 0)
+    dstop[i] = 2;
+  else
+    dstop[i] = 0;
+  deol[i] = (s & (final | eolfinal)) != 0;
+  nstate++;
+  return i;
+}
+
+// Compute the state after byte c from state st.  When the
+// table is full it is emptied and refilled as needed.
+static int
+step(int st, int c)
+{
+  set s, t;
+  int j, n;
+
+  s = dset[st];
+  t = starts;
+  for(j = 0; j < npos; j++){
+    if(!(s & BIT(j)) || ((final | eolfinal) & BIT(j)))
+      continue;
+    if(atomany[j] || atomc[j] == c)
+      t |= atomstar[j] ? BIT(j) : BIT(j+1);
   }
+  t = closure(t);
+  if(nstate == NSTATE){
+    nstate = 0;
+    dstart = addstate(closure(linestarts));
+    return addstate(t);
+  }
+  n = addstate(t);
+  dnext[st][c] = n;
+  return n;
+}
 
-  for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf(1, "grep: cannot open %s\n", argv[i]);
-      exit();
-    }
-    grep(pattern, fd);
-    close(fd);
+// Return the first occurrence of lit in p[0..n), or 0.
+static char*
+horspool(char *p, int n)
+{
+  char *e;
+  int i;
+
+  e = p + n - nlit;
+  while(p <= e){
+    for(i = nlit - 1; p[i] == lit[i]; i--)
+      if(i == 0)
+        return p;
+    p += litskip[(uchar)p[nlit-1]];
   }
-  exit();
+  return 0;
 }
 
-// Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9.
+static void
+flushout(void)
+{
+  if(outn > 0)
+    write(1, outp, outn);
+  outn = 0;
+}
 
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
+// Queue line p[0..n) for output, with its newline if it has one.
+static void
+emit(char *p, int n, int nl)
+{
+  if(outn > 0 && outp + outn != p)
+    flushout();
+  if(outn == 0)
+    outp = p;
+  outn += n + nl;
+  if(!nl){
+    flushout();
+    write(1, "\n", 1);
+  }
+}
 
-int
-match(char *re, char *text)
+// Search the lines in p[0..n).  The last one is searched without
+// a newline only if eof; otherwise it is left for the next call.
+// Returns the number of bytes searched.
+static int
+scan(char *p, int n, int eof)
 {
-  if(re[0] == '^')
-    return matchhere(re+1, text);
-  do{  // must look at empty string
-    if(matchhere(re, text))
-      return 1;
-  }while(*text++ != '\0');
-  return 0;
+  char *e, *line, *q, *hit;
+  int st, t;
+
+  e = p + n;
+  line = p;
+  while(line < e){
+    if(lit){
+      if((hit = horspool(line, e - line)) == 0){
+        if(eof)
+          return n;
+        // Keep the last line, which may yet match.
+        for(q = e; q > line && q[-1] != '\n'; q--)
+          ;
+        return q - p;
+      }
+      for(; hit > line && hit[-1] != '\n'; hit--)
+        ;
+      line = hit;
+    }
+    st = dstart;
+    for(q = line; q < e && *q != '\n' && !dstop[st]; q++){
+      if((t = dnext[st][(uchar)*q]) < 0)
+        t = step(st, (uchar)*q);
+      st = t;
+    }
+    if(dstop[st])
+      while(q < e && *q != '\n')
+        q++;
+    if(q == e && !eof)
+      break;
+    if(dstop[st] == 1 || (dstop[st] == 0 && deol[st]))
+      emit(line, q - line, q < e);
+    line = q + 1;
+  }
+  if(line > e)
+    line = e;
+  return line - p;
 }
 
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
+static void
+grep(int fd)
 {
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
-  return 0;
+  struct stat st;
+  char *p;
+  int n, m;
+
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+    scan(p, st.size, 1);
+    flushout();
+    munmap(p, st.size);
+    return;
+  }
+
+  m = 0;
+  while((n = read(fd, buf+m, sizeof(buf)-m)) > 0){
+    m += n;
+    n = scan(buf, m, 0);
+    if(n == 0 && m == sizeof(buf))
+      n = scan(buf, m, 1);  // A line too long for buf.
+    flushout();
+    m -= n;
+    memmove(buf, buf+n, m);
+  }
+  if(m > 0)
+    scan(buf, m, 1);
+  flushout();
 }
 
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
+static int
+grepfile(char *name)
 {
-  do{  // a * matches zero or more instances
-    if(matchhere(re, text))
-      return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
+  int fd;
+
+  if((fd = open(name, 0)) < 0){
+    printf(2, "grep: cannot open %s\n", name);
+    return -1;
+  }
+  grep(fd);
+  close(fd);
   return 0;
 }
 
+int
+main(int argc, char *argv[])
+{
+  int i, nworker, npat;
+  char *first;
+
+  nworker = NWORKER;
+  npat = 0;
+  first = 0;
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-j") == 0)
+      nworker = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-e") == 0){
+      compile(argv[i+1]);
+      if(npat++ == 0)
+        first = argv[i+1];
+    } else
+      break;
+  }
+  if(npat == 0 && i < argc){
+    compile(argv[i]);
+    first = argv[i++];
+    npat++;
+  }
+  if(npat == 0){
+    printf(2, "usage: grep [-j n] [-e pattern]... [pattern] [file ...]\n");
+    exit();
+  }
+  if(npat == 1 && first[0] != '^')
+    findliteral(first);
+  dstart = addstate(closure(linestarts));
+
+  if(i >= argc){
+    grep(0);
+    exit();
+  }
+  if(argc - i > 1 && nworker > 1){
+    if(forkeach(argv + i, argc - i, nworker, grepfile) < 0)
+      printf(2, "grep: cannot start worker\n");
+    exit();
+  }
+  for(; i < argc; i++)
+    if(grepfile(argv[i]) < 0)
+      exit();
+  exit();
+}
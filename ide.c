@@ -93,7 +93,7 @@ idestart(struct buf *b)
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outsl(0x1f0, b->addr ? b->addr : b->data, BSIZE/4);
   } else {
     outb(0x1f7, read_cmd);
   }
@@ -116,7 +116,7 @@ ideintr(void)
 
   // Read data if needed.
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+    insl(0x1f0, b->addr ? b->addr : b->data, BSIZE/4);
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
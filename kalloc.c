@@ -1,6 +1,8 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+// Pages can be shared, for example between the page cache
+// and page tables; each page has a count of its references.
 
 #include "types.h"
 #include "defs.h"
@@ -21,6 +23,7 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  ushort ref[PHYSTOP/PGSIZE];  // References to each physical page
 } kmem;
 
 // Initialization happens in two phases.
@@ -52,10 +55,11 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(char *v)
 {
@@ -64,6 +68,18 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -87,10 +103,35 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to the page at v, which some other
+// user already has a reference to; kfree drops it.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] == 0 || kmem.ref[V2P(v)/PGSIZE] == 0xFFFF)
+    panic("kref: count");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Return the number of references to the page at v.
+int
+krefs(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
+
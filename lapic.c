@@ -31,6 +31,7 @@
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
+  #define ONESHOT    0x00000000   // One-shot
   #define PERIODIC   0x00020000   // Periodic
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
@@ -43,6 +44,20 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+// Timer counts and TSC cycles per tick, set by calibrate().
+// Idle countdowns are limited so that a full countdown plus
+// a carried fraction still fits in a uint.
+static uint period;
+static uint tsctick;
+#define MAXIDLE 0x7FFFFFFF
+
+// Channel 2 of the 8253 PIT, used to calibrate against.
+#define PIT_HZ     1193182  // PIT input clock
+#define PIT_CH2    0x42     // Channel 2 count
+#define PIT_MODE   0x43     // Mode/command
+#define PIT_GATE   0x61     // Channel 2 gate (bit 0) and output (bit 5)
+#define CALMS      50       // Calibration time in milliseconds
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,6 +66,40 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+// Measure the lapic timer's bus clock and the TSC against
+// channel 2 of the PIT, whose input clock has a known rate,
+// and set period and tsctick for HZ ticks per second.
+// The boot CPU runs this once, with interrupts off.
+static void
+calibrate(void)
+{
+  uint latch, l0, l1;
+  uint64 t0, t1;
+
+  // Let the lapic timer count down from its maximum, masked.
+  lapicw(TDCR, X1);
+  lapicw(TIMER, MASKED | ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, 0xFFFFFFFF);
+
+  // In mode 0, channel 2's output goes high when its count
+  // runs out, which takes latch/PIT_HZ seconds.
+  latch = PIT_HZ / 1000 * CALMS;
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PIT_MODE, 0xB0);  // channel 2, low then high byte, mode 0
+  outb(PIT_CH2, latch & 0xFF);
+  outb(PIT_CH2, latch >> 8);  // starts counting
+  l0 = lapic[TCCR];
+  t0 = rdtsc();
+  while((inb(PIT_GATE) & 0x20) == 0)
+    ;
+  t1 = rdtsc();
+  l1 = lapic[TCCR];
+
+  // Counts per tick = counts * PIT_HZ / (latch * HZ).
+  period = divl((uint64)(l0 - l1) * PIT_HZ, latch * HZ);
+  tsctick = divl((t1 - t0) * PIT_HZ, latch * HZ);
+}
+
 void
 lapicinit(void)
 {
@@ -60,13 +109,15 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
+  if(period == 0)
+    calibrate();
+
   // The timer repeatedly counts down at bus frequency
   // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // TICR is calibrated to give HZ interrupts per second.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, period);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,6 +164,79 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Return the number of TSC cycles per tick,
+// as measured by calibrate().
+uint
+lapictsc(void)
+{
+  return tsctick;
+}
+
+// Send an interrupt with the given vector to the CPU with the given
+// APIC ID.  Used to wake idle CPUs; see kick in proc.c.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Stop the periodic tick while this CPU has nothing to run.
+// If n > 0, arm a one-shot countdown so that the CPU is interrupted
+// after at most n ticks.  Otherwise mask the timer and leave it to
+// other interrupts (devices, a wakeup IPI) to end the halt.
+void
+lapicidle(uint n)
+{
+  if(!lapic)
+    return;
+  if(n == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    return;
+  }
+  if(n > MAXIDLE / period)
+    n = MAXIDLE / period;
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, n * period);
+}
+
+// Restart the periodic tick after lapicidle().  Returns the number
+// of whole ticks that passed on the countdown and were not already
+// reported by a timer interrupt.  The leftover fraction of a tick is
+// carried into the next call so that the CPU keeping time (the only
+// one that arms a countdown) does not drift however often it idles.
+uint
+lapicresume(void)
+{
+  static uint carry;
+  uint init, cur, n;
+
+  if(!lapic)
+    return 0;
+  if(lapic[TIMER] & MASKED){
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, period);
+    return 0;
+  }
+  init = lapic[TICR];
+  cur = lapic[TCCR];
+  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, period);
+
+  // An expired countdown raised an interrupt, which counted one tick.
+  if(cur == 0)
+    carry += init - period;
+  else
+    carry += init - cur;
+  n = carry / period;
+  carry %= period;
+  return n;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
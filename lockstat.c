@@ -0,0 +1,78 @@
+// Print the kernel's lock statistics.
+//   lockstat             counters since boot or the last profile
+//   lockstat cmd [arg...] profile cmd, then print the counters
+// Call sites are kernel addresses; look them up with
+// addr2line -e kernel.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NSTAT 512
+#define NTOP  10
+
+struct lockstat st[NSTAT];
+
+// Sort by decreasing wait time.
+void
+sort(struct lockstat *s, int n)
+{
+  struct lockstat t;
+  int i, j;
+
+  for(i = 1; i < n; i++){
+    t = s[i];
+    for(j = i; j > 0 && s[j-1].wait < t.wait; j--)
+      s[j] = s[j-1];
+    s[j] = t;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid, top;
+
+  if(argc > 1){
+    lockprof(1);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+    lockprof(0);
+  }
+
+  n = lockstat(st, NSTAT);
+  if(n < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+  sort(st, n);
+
+  printf(1, "lock acquires contended wait(us) hold(us)\n");
+  for(i = top = 0; i < n && top < NTOP; i++){
+    if(st[i].pc != 0)
+      continue;
+    printf(1, "%s %d %d %d %d\n", st[i].name, st[i].nacquire,
+           st[i].ncontend, st[i].wait, st[i].hold);
+    top++;
+  }
+
+  printf(1, "\ncall site lock contended wait(us)\n");
+  for(i = top = 0; i < n && top < NTOP; i++){
+    if(st[i].pc == 0)
+      continue;
+    printf(1, "%x %s %d %d\n", st[i].pc, st[i].name,
+           st[i].ncontend, st[i].wait);
+    top++;
+  }
+  exit();
+}
@@ -0,0 +1,12 @@
+// Lock statistics, as returned by lockstat().
+// An entry with pc == 0 totals all the locks of one name;
+// the others are call sites that had to wait for the lock
+// while profiling was on (see lockprof()).
+struct lockstat {
+  char name[16];  // Name of lock
+  uint pc;        // Kernel address that called acquire, or 0
+  uint nacquire;  // Number of acquisitions (totals only)
+  uint ncontend;  // Acquisitions that had to wait
+  uint wait;      // Microseconds spent waiting
+  uint hold;      // Microseconds held (totals only)
+};
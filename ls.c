@@ -22,12 +22,15 @@ fmtname(char *path)
   return buf;
 }
 
+// Directory entries come many per getdents call, and each is
+// looked up in the open directory with fstatat, instead of by
+// its whole path name.
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  static struct dirent de[64];
+  char name[DIRSIZ+1];
+  int fd, i, n;
   struct stat st;
 
   if((fd = open(path, 0)) < 0){
@@ -47,23 +50,16 @@ ls(char *path)
     break;
 
   case T_DIR:
-    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
-      printf(1, "ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf(1, "ls: cannot stat %s\n", buf);
-        continue;
+    while((n = getdents(fd, de, sizeof(de))) > 0){
+      for(i = 0; i < n / sizeof(de[0]); i++){
+        memmove(name, de[i].name, DIRSIZ);
+        name[DIRSIZ] = 0;
+        if(fstatat(fd, name, &st) < 0){
+          printf(1, "ls: cannot stat %s\n", name);
+          continue;
+        }
+        printf(1, "%s %d %d %d\n", fmtname(name), st.type, st.ino, st.size);
       }
-      printf(1, "%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
     break;
   }
@@ -27,8 +27,12 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  mminit();        // address spaces
   tvinit();        // trap vectors
+  timerinit();     // kernel timers
+  futexinit();     // futexes
   binit();         // buffer cache
+  pageinit();      // page cache
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
@@ -53,8 +53,8 @@ iderw(struct buf *b)
 
   if(b->flags & B_DIRTY){
     b->flags &= ~B_DIRTY;
-    memmove(p, b->data, BSIZE);
+    memmove(p, b->addr ? b->addr : b->data, BSIZE);
   } else
-    memmove(b->data, p, BSIZE);
+    memmove(b->addr ? b->addr : b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
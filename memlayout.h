@@ -8,6 +8,12 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// User-visible page of clock data, mapped read-only into every
+// process just below the kernel (see struct clockdata in date.h).
+#define CLOCKPAGE (KERNBASE-PGSIZE)
+#define USERTOP   CLOCKPAGE         // End of memory a process can allocate
+#define SYSENTEROK (CLOCKPAGE+24)   // Address of clockdata.sysenter
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
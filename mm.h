@@ -0,0 +1,34 @@
+// A region of user memory whose pages are filled in when
+// the process first touches them (see pagefault in vm.c).
+struct vma {
+  uint start;                  // First address, page aligned
+  uint end;                    // End address, page aligned; 0 if unused
+  int flags;                   // VMA_WRITE, VMA_SHARED
+  struct inode *ip;            // File the pages come from
+  uint off;                    // Offset in ip of start
+  uint filesz;                 // Bytes from ip; the rest reads as zero
+};
+
+#define VMA_WRITE  0x1         // Writable
+#define VMA_SHARED 0x2         // Map the page cache's pages, even if writable
+
+// An address space: a page table and the regions of user
+// memory it maps.  The threads of a process share one (see
+// clone in proc.c); the last to let go of it frees it.
+struct mm {
+  struct sleeplock lock;       // Protects everything below here
+  int ref;                     // Threads using it; protected by mmtable.lock
+  struct proc *execer;         // Thread in exec (see killthreads); protected by ptable.lock
+  uint sz;                     // Size of process memory (bytes)
+  pde_t* pgdir;                // Page table
+  struct vma vma[NVMA];        // Lazily mapped regions of memory
+};
+
+// Process memory is laid out contiguously, low addresses first:
+//   text
+//   original data and bss
+//   fixed-size stack
+//   expandable heap
+// exec maps text, data and bss as vmas, so their pages are
+// only read from the program file when first used.
+// mmap places vmas at the top of user memory, below USERTOP.
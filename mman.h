@@ -0,0 +1,8 @@
+#define PROT_READ     0x1   // Pages may be read
+#define PROT_WRITE    0x2   // Pages may be written
+
+#define MAP_SHARED    0x01  // Stores go to the file and other mappings
+#define MAP_PRIVATE   0x02  // Stores go to a private copy
+#define MAP_ANONYMOUS 0x20  // Zeroed memory, not a file; fd is ignored
+
+#define MAP_FAILED    ((void*)-1)
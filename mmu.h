@@ -2,7 +2,11 @@
 // x86 memory management unit (MMU).
 
 // Eflags register
+#define FL_TF           0x00000100      // Trap (single step)
 #define FL_IF           0x00000200      // Interrupt Enable
+#define FL_DF           0x00000400      // Direction
+#define FL_NT           0x00004000      // Nested Task
+#define FL_AC           0x00040000      // Alignment Check
 
 // Control Register flags
 #define CR0_PE          0x00000001      // Protection Enable
@@ -11,6 +15,14 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// cpuid leaf 1 feature flags, in %edx
+#define CPUID_SEP       0x00000800      // sysenter and sysexit
+
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS  0x174          // Kernel %cs; %ss is the next selector
+#define MSR_SYSENTER_ESP 0x175          // Kernel %esp
+#define MSR_SYSENTER_EIP 0x176          // Kernel entry point
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
@@ -94,12 +106,17 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_S           0x200   // Shared: fork maps the page, not a copy
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
+// Page fault error code bits
+#define FEC_WR          0x002   // Fault was caused by a write
+
 #ifndef __ASSEMBLER__
 typedef uint pte_t;
 
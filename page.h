@@ -0,0 +1,11 @@
+struct page {
+  uint dev;          // Device of the file, or 0 if unused
+  uint inum;         // Inode number of the file
+  uint off;          // Offset of the page in the file
+  int valid;         // has data been read from the file?
+  uint refcnt;       // Users between pageget and pageput
+  char *data;        // The page itself, from kalloc
+  struct page *hnext; // hash chain
+  struct page *prev; // LRU list
+  struct page *next;
+};
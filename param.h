@@ -11,4 +11,7 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define NPAGE        1024  // size of page cache
+#define NVMA         16  // lazily mapped regions per process
+#define HZ          100  // timer interrupts per second (see lapicinit)
 
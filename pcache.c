@@ -0,0 +1,248 @@
+// Page cache.
+//
+// The page cache holds whole pages of file content, so that
+// they can be mapped into user page tables: processes running
+// the same program share its read-only text pages (see
+// pagefault in vm.c).  Pages are named by device, inode
+// number and file offset, and hashed on those.
+//
+// Interface:
+// * To get a page of a file, call pageget with the inode
+//     locked; it reads the page from the file if needed.
+// * readi reads regular files with pageread; O_DIRECT reads
+//     go around the cache only for pages pagecached says it
+//     does not have.
+// * To keep a page mapped after pageput, take a kref on
+//     its data.
+// * Call pageput when done with the page.
+// * writei calls pagewrite to keep cached pages current,
+//     and itrunc calls pageinval to discard a file's pages.
+//
+// A page's data and valid flag are only touched with the
+// file's inode lock held; pcache.lock protects the rest.
+// A page whose data is still mapped somewhere (has more
+// than the cache's own kalloc reference) is not recycled,
+// so every mapping of a file offset sees the same page.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "page.h"
+
+#define NPHASH 127
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct {
+  struct spinlock lock;
+  struct page page[NPAGE];
+  struct page *hash[NPHASH];
+
+  // Linked list of all pages, through prev/next.
+  // head.next is most recently used.
+  struct page head;
+} pcache;
+
+void
+pageinit(void)
+{
+  struct page *pg;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPAGE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+static struct page**
+bucket(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[(dev*31 + inum*17 + off/PGSIZE) % NPHASH];
+}
+
+// Find the cached page of the file at offset off.
+// Caller must hold pcache.lock.
+static struct page*
+lookup(uint dev, uint inum, uint off)
+{
+  struct page *pg;
+
+  for(pg = *bucket(dev, inum, off); pg; pg = pg->hnext)
+    if(pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  return 0;
+}
+
+// Remove pg from its hash chain and forget its name.
+// Caller must hold pcache.lock.
+static void
+unhash(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = bucket(pg->dev, pg->inum, pg->off); *pp; pp = &(*pp)->hnext){
+    if(*pp == pg){
+      *pp = pg->hnext;
+      break;
+    }
+  }
+  pg->dev = 0;
+  pg->valid = 0;
+}
+
+// Return the page of ip at offset off, which must be page
+// aligned, reading it from the file if it is not cached.
+// Bytes past the end of the file read as zero.
+// Caller must hold ip->lock.  Returns 0 if every page is in
+// use or there is no memory.
+struct page*
+pageget(struct inode *ip, uint off)
+{
+  struct page *pg;
+  int n;
+
+  acquire(&pcache.lock);
+  if((pg = lookup(ip->dev, ip->inum, off)) != 0){
+    pg->refcnt++;
+    release(&pcache.lock);
+  } else {
+    // Not cached; recycle the least recently used unused page.
+    for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+      if(pg->refcnt == 0 && (pg->data == 0 || krefs(pg->data) == 1))
+        break;
+    if(pg == &pcache.head){
+      release(&pcache.lock);
+      return 0;
+    }
+    if(pg->dev)
+      unhash(pg);
+    pg->dev = ip->dev;
+    pg->inum = ip->inum;
+    pg->off = off;
+    pg->refcnt = 1;
+    pg->hnext = *bucket(pg->dev, pg->inum, pg->off);
+    *bucket(pg->dev, pg->inum, pg->off) = pg;
+    release(&pcache.lock);
+  }
+
+  if(!pg->valid){
+    if(pg->data == 0 && (pg->data = kalloc()) == 0){
+      pageput(pg);
+      return 0;
+    }
+    if((n = readblocks(ip, pg->data, off, PGSIZE)) < 0)
+      n = 0;
+    memset(pg->data + n, 0, PGSIZE - n);
+    pg->valid = 1;
+  }
+  return pg;
+}
+
+// Is the page of ip at offset off cached?  It may hold stores
+// through shared mappings that the disk does not have yet.
+// Caller must hold ip->lock.
+int
+pagecached(struct inode *ip, uint off)
+{
+  struct page *pg;
+  int r;
+
+  acquire(&pcache.lock);
+  pg = lookup(ip->dev, ip->inum, off);
+  r = pg != 0 && pg->valid;
+  release(&pcache.lock);
+  return r;
+}
+
+// Done with page pg; move it to the head of the LRU list.
+void
+pageput(struct page *pg)
+{
+  acquire(&pcache.lock);
+  pg->refcnt--;
+  if(pg->refcnt == 0){
+    pg->next->prev = pg->prev;
+    pg->prev->next = pg->next;
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+  release(&pcache.lock);
+}
+
+// Read data from inode ip through the page cache.
+// Caller must hold ip->lock.
+int
+pageread(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct page *pg;
+  uint tot, m;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pageget(ip, PGROUNDDOWN(off))) == 0){
+      // All pages are in use; go around the cache.
+      if(readblocks(ip, dst, off, m) != m)
+        return -1;
+      continue;
+    }
+    memmove(dst, pg->data + off%PGSIZE, m);
+    pageput(pg);
+  }
+  return n;
+}
+
+// Copy the n bytes at src, just written to ip at offset
+// off, into any cached pages they fall in.
+// Caller must hold ip->lock.
+void
+pagewrite(struct inode *ip, char *src, uint off, uint n)
+{
+  struct page *pg;
+  uint a, m;
+
+  for(; n > 0; n -= m, off += m, src += m){
+    a = PGROUNDDOWN(off);
+    m = min(n, a + PGSIZE - off);
+    acquire(&pcache.lock);
+    if((pg = lookup(ip->dev, ip->inum, a)) != 0)
+      pg->refcnt++;
+    release(&pcache.lock);
+    if(pg){
+      // src is the page itself when vm.c writes back
+      // a page stored into through a shared mapping.
+      if(pg->valid && pg->data + off - a != src)
+        memmove(pg->data + off - a, src, m);
+      pageput(pg);
+    }
+  }
+}
+
+// Discard the cached pages of ip, whose content is going away.
+// Caller must hold ip->lock.
+void
+pageinval(struct inode *ip)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < pcache.page+NPAGE; pg++)
+    if(pg->dev == ip->dev && pg->inum == ip->inum)
+      unhash(pg);
+  release(&pcache.lock);
+}
@@ -7,18 +7,37 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a power-of-two number of pages, one to
+// start with; F_SETPIPE_SZ (see pipesize) changes it.
+#define PIPEPAGES  1
+#define MAXPIPEPAGES 16
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[MAXPIPEPAGES]; // the buffer
+  uint size;      // bytes in the buffer
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int nreader;    // readers sleeping for data
+  int nwriter;    // writers sleeping for space
+  struct waitq wq; // pollers
 };
 
+// Byte i of p's data stream.
+#define PIPEBYTE(p, i) \
+  ((p)->page[((i) & ((p)->size-1)) / PGSIZE][(i) % PGSIZE])
+
+// Bytes from stream offset i to the end of its buffer page:
+// the longest run that can be copied with one memmove.
+#define PIPERUN(i)  (PGSIZE - (i) % PGSIZE)
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,25 +49,37 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  if((p->page[0] = kalloc()) == 0)
+    goto bad;
+  p->size = PIPEPAGES*PGSIZE;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
   initlock(&p->lock, "pipe");
+  p->wq.lock = &p->lock;
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
+  (*f0)->nonblock = 0;
+  (*f0)->direct = 0;
   (*f0)->pipe = p;
   (*f1)->type = FD_PIPE;
   (*f1)->readable = 0;
   (*f1)->writable = 1;
+  (*f1)->nonblock = 0;
+  (*f1)->direct = 0;
   (*f1)->pipe = p;
   return 0;
 
 //PAGEBREAK: 20
  bad:
-  if(p)
+  if(p){
+    if(p->page[0])
+      kfree(p->page[0]);
     kfree((char*)p);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -56,6 +87,63 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+static void
+pagesfree(char **page, uint size)
+{
+  int i;
+
+  for(i = 0; i < size/PGSIZE; i++)
+    kfree(page[i]);
+}
+
+// Change the size of p's buffer to n bytes, rounded up to a
+// power-of-two number of pages.  Fails if the data already
+// in the pipe does not fit.  Returns the new size, or -1.
+// If n is 0, just returns the size.
+int
+pipesize(struct pipe *p, int n)
+{
+  char *page[MAXPIPEPAGES], *old[MAXPIPEPAGES];
+  uint size, oldsize, i, m, r;
+
+  if(n == 0)
+    return p->size;
+  if(n < 0 || n > MAXPIPEPAGES*PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size *= 2)
+    ;
+  for(i = 0; i < size/PGSIZE; i++){
+    if((page[i] = kalloc()) == 0){
+      pagesfree(page, i*PGSIZE);
+      return -1;
+    }
+  }
+
+  acquire(&p->lock);
+  m = p->nwrite - p->nread;
+  if(m > size){
+    release(&p->lock);
+    pagesfree(page, size);
+    return -1;
+  }
+  for(i = 0; i < m; i += r){
+    r = min(m - i, min(PIPERUN(p->nread + i), PIPERUN(i)));
+    memmove(&page[i / PGSIZE][i % PGSIZE], &PIPEBYTE(p, p->nread + i), r);
+  }
+  memmove(old, p->page, sizeof(old));
+  oldsize = p->size;
+  memmove(p->page, page, sizeof(page));
+  p->size = size;
+  p->nread = 0;
+  p->nwrite = m;
+  if(p->nwriter)
+    wakeup(&p->nwrite);
+  pollwakeup(&p->wq);
+  release(&p->lock);
+  pagesfree(old, oldsize);
+  return size;
+}
+
 void
 pipeclose(struct pipe *p, int writable)
 {
@@ -67,40 +155,125 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  pollwakeup(&p->wq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    pagesfree(p->page, p->size);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
+// Return the number of bytes waiting to be read from p.
+int
+pipeavail(struct pipe *p)
+{
+  int n;
+
+  acquire(&p->lock);
+  n = p->nwrite - p->nread;
+  release(&p->lock);
+  return n;
+}
+
+// Wait until p has room to write.  Returns -1 if the read
+// end is closed or the process has been killed.
+int
+pipewait(struct pipe *p)
+{
+  acquire(&p->lock);
+  while(p->nwrite == p->nread + p->size){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    p->nwriter++;
+    sleep(&p->nwrite, &p->lock);
+    p->nwriter--;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Return which of POLLIN, POLLOUT, POLLERR and POLLHUP hold for
+// the read end of p, or the write end if writable, and add pw
+// to p's pollers.
+int
+pipepoll(struct pipe *p, int writable, struct poller *pw)
+{
+  int r;
+
+  r = 0;
+  acquire(&p->lock);
+  pollwait(&p->wq, pw);
+  if(writable){
+    if(p->readopen == 0)
+      r |= POLLERR;
+    else if(p->nwrite - p->nread < p->size)
+      r |= POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      r |= POLLIN;
+    if(p->writeopen == 0)
+      r |= POLLHUP;
+  }
+  release(&p->lock);
+  return r;
+}
+
 //PAGEBREAK: 40
+// Wakeups are batched: a writer wakes readers when the buffer
+// fills or its write is done, and a reader wakes writers only
+// once there is room for a good amount of data, half the buffer
+// or a page, and only when someone is asleep, since wakeup
+// scans the whole process table.  Pollers are told about
+// every change.
+// Data moves in runs, each as long as the room in the buffer
+// and the current page allow.
+// If nonblock is set, write what fits and return, or EAGAIN if
+// nothing does, instead of waiting for room.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
 {
-  int i;
+  int i, m;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(nonblock)
+        goto done;
+      if(p->nreader)
+        wakeup(&p->nread);
+      pollwakeup(&p->wq);
+      p->nwriter++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->nwriter--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    m = min(n - i, p->size - (p->nwrite - p->nread));
+    m = min(m, PIPERUN(p->nwrite));
+    memmove(&PIPEBYTE(p, p->nwrite), addr + i, m);
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+done:
+  if(p->nreader)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  pollwakeup(&p->wq);
   release(&p->lock);
-  return n;
+  if(i == 0 && n > 0)
+    return EAGAIN;
+  return i;
 }
 
+// If nonblock is set, return EAGAIN instead of waiting for data.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
-  int i;
+  int i, m;
+  uint free;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -108,14 +281,25 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    if(nonblock){
+      release(&p->lock);
+      return EAGAIN;
+    }
+    p->nreader++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->nreader--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    m = min(n - i, p->nwrite - p->nread);
+    m = min(m, PIPERUN(p->nread));
+    memmove(addr + i, &PIPEBYTE(p, p->nread), m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  free = p->size - (p->nwrite - p->nread);
+  if(p->nwriter && (free >= p->size/2 || free >= PGSIZE))
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(i > 0)
+    pollwakeup(&p->wq);
   release(&p->lock);
   return i;
 }
@@ -0,0 +1,73 @@
+// Measure pipe throughput.
+//   pipebench [kbytes [chunk [pipesize]]]
+// A child writes kbytes (default 4096) through a pipe in
+// chunk-byte writes (default 4096); the parent reads them and
+// prints the rate.  pipesize, if given, is set with F_SETPIPE_SZ.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+
+#define MAXCHUNK (64*1024)
+
+char buf[MAXCHUNK];
+
+int
+main(int argc, char *argv[])
+{
+  int p[2], kb, chunk, n, m;
+  uint total, got, ms;
+  struct timespec t0, t1;
+
+  kb = argc > 1 ? atoi(argv[1]) : 4096;
+  chunk = argc > 2 ? atoi(argv[2]) : 4096;
+  if(kb <= 0 || chunk <= 0 || chunk > MAXCHUNK){
+    printf(2, "usage: pipebench [kbytes [chunk [pipesize]]]\n");
+    exit();
+  }
+  if(pipe(p) < 0){
+    printf(2, "pipebench: pipe failed\n");
+    exit();
+  }
+  if(argc > 3 && fcntl(p[0], F_SETPIPE_SZ, atoi(argv[3])) < 0){
+    printf(2, "pipebench: cannot set pipe size %s\n", argv[3]);
+    exit();
+  }
+  total = kb * 1024;
+
+  clocknow(CLOCK_MONOTONIC, &t0);
+  n = fork();
+  if(n < 0){
+    printf(2, "pipebench: fork failed\n");
+    exit();
+  }
+  if(n == 0){
+    close(p[0]);
+    for(got = 0; got < total; got += m){
+      m = total - got < chunk ? total - got : chunk;
+      if(write(p[1], buf, m) != m){
+        printf(2, "pipebench: write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(p[1]);
+  for(got = 0; (n = read(p[0], buf, chunk)) > 0; got += n)
+    ;
+  wait();
+  clocknow(CLOCK_MONOTONIC, &t1);
+
+  if(got != total){
+    printf(2, "pipebench: read %d of %d bytes\n", got, total);
+    exit();
+  }
+  ms = (t1.sec - t0.sec) * 1000 + (t1.nsec / 1000000) - (t0.nsec / 1000000);
+  if(ms == 0)
+    ms = 1;
+  printf(1, "%d KB in %d ms, chunk %d: %d KB/s\n", kb, ms, chunk,
+    (uint)kb * 1000 / ms);
+  exit();
+}
@@ -0,0 +1,142 @@
+// Waiting for any of several files to become ready.
+//
+// A process in poll() hangs a pollent on the wait queue of each
+// pipe or device it polls and goes to sleep.  Whatever makes one
+// of them ready calls pollwakeup, which marks the poller ready and
+// wakes it to look at all its files again.  The poller's ready
+// flag and its timeout timer are both protected by tickslock, so
+// the poller cannot miss either one between checking and sleeping.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "timer.h"
+#include "poll.h"
+
+struct pollent {
+  struct pollent *next;  // Next on q
+  struct waitq *q;       // Queue this entry is on
+  struct poller *pw;     // Process to wake
+};
+
+struct poller {
+  struct timer timer;    // Fires at the timeout; also the sleep channel
+  int ready;             // Set by pollwakeup
+  int n;                 // Entries in use
+  struct pollent ent[NOFILE];
+};
+
+// Arrange for pw to be woken when q's object changes.
+// Does nothing if pw is 0.  Caller must hold q->lock.
+void
+pollwait(struct waitq *q, struct poller *pw)
+{
+  struct pollent *e;
+
+  if(pw == 0)
+    return;
+  if(pw->n == NELEM(pw->ent))
+    panic("pollwait");
+  e = &pw->ent[pw->n++];
+  e->q = q;
+  e->pw = pw;
+  e->next = q->head;
+  q->head = e;
+}
+
+// Wake the processes polling q's object.
+// Caller must hold q->lock.
+void
+pollwakeup(struct waitq *q)
+{
+  struct pollent *e;
+
+  if(q->head == 0)
+    return;
+  acquire(&tickslock);
+  for(e = q->head; e; e = e->next){
+    e->pw->ready = 1;
+    wakeup(&e->pw->timer);
+  }
+  release(&tickslock);
+}
+
+// Fill in fds[i].revents for each of the nfds entries, waiting
+// until at least one is non-zero or timeout milliseconds have
+// passed; a negative timeout waits forever, and 0 not at all.
+// Returns the number of entries with non-zero revents, 0 on
+// timeout, or -1 if the process is killed.
+int
+poll(struct pollfd *fds, int nfds, int timeout)
+{
+  struct file *f[NOFILE];
+  struct poller pw, *w;
+  struct pollent *e, **pp;
+  int i, n, r;
+
+  if(nfds > NELEM(f))
+    return -1;
+  for(i = 0; i < nfds; i++)
+    f[i] = fdget(fds[i].fd);
+  pw.ready = 0;
+  pw.n = 0;
+  pw.timer.pending = 0;
+  if(timeout > 0){
+    acquire(&tickslock);
+    timeradd(&pw.timer, ticks + (timeout + 1000/HZ - 1) / (1000/HZ));
+    release(&tickslock);
+  }
+
+  // Join the wait queues on the first pass only.
+  for(w = &pw;; w = 0){
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      r = 0;
+      if(f[i])
+        r = filepoll(f[i], w) & (fds[i].events | POLLERR | POLLHUP);
+      else if(fds[i].fd >= 0)
+        r = POLLNVAL;
+      fds[i].revents = r;
+      if(r)
+        n++;
+    }
+    if(n > 0 || timeout == 0)
+      break;
+    acquire(&tickslock);
+    while(!pw.ready && (timeout < 0 || pw.timer.pending) && !myproc()->killed)
+      sleep(&pw.timer, &tickslock);
+    r = pw.ready;
+    pw.ready = 0;
+    release(&tickslock);
+    if(myproc()->killed){
+      n = -1;
+      break;
+    }
+    if(!r)
+      break;  // timed out
+  }
+
+  if(timeout > 0){
+    acquire(&tickslock);
+    timerdel(&pw.timer);
+    release(&tickslock);
+  }
+  for(i = 0; i < pw.n; i++){
+    e = &pw.ent[i];
+    acquire(e->q->lock);
+    for(pp = &e->q->head; *pp != e; pp = &(*pp)->next)
+      ;
+    *pp = e->next;
+    release(e->q->lock);
+  }
+  for(i = 0; i < nfds; i++)
+    if(f[i])
+      fileclose(f[i]);
+  return n;
+}
@@ -0,0 +1,12 @@
+// poll(): wait for any of several files to become ready.
+struct pollfd {
+  int fd;         // File descriptor, or negative to skip
+  short events;   // Conditions to wait for
+  short revents;  // Conditions that hold, filled in by poll
+};
+
+#define POLLIN    0x001  // Data to read, or end of file
+#define POLLOUT   0x004  // Room to write
+#define POLLERR   0x008  // Pipe with no reader left
+#define POLLHUP   0x010  // Pipe with no writer left
+#define POLLNVAL  0x020  // fd is not open
@@ -1,15 +1,55 @@
 #include "types.h"
 #include "stat.h"
+#include "param.h"
 #include "user.h"
 
+// printf formats into a per-fd buffer and writes it out with
+// one write, instead of one write per character.  fd 2 is
+// written at the end of every printf, a console whenever a
+// newline is printed, and anything else (files and pipes) when
+// the buffer fills, on fflush, close or exit.  As with stdio,
+// output still in a buffer at fork is printed by both processes.
+
+#define BUFSIZE 512
+
+enum { UNKNOWN, UNBUF, LINEBUF, FULLBUF };
+
+static struct fdbuf {
+  char buf[BUFSIZE];
+  int n;         // Bytes waiting in buf.
+  int mode;      // When to write them out.
+} fdbuf[NOFILE];
+
+static struct mutex fdlock;  // Protects fdbuf for threads.
+
+// Where format puts its output: a buffer that is written to fd
+// when it fills, or, if fd is -1, a string that drops the rest.
+struct out {
+  int fd;
+  char *buf;
+  int n;         // Bytes in buf.
+  int size;      // Room in buf.
+  int total;     // Bytes formatted, including any dropped.
+  int nl;        // A newline was formatted.
+};
+
 static void
-putc(int fd, char c)
+putc(struct out *o, char c)
 {
-  write(fd, &c, 1);
+  o->total++;
+  if(o->n == o->size){
+    if(o->fd < 0)
+      return;
+    write(o->fd, o->buf, o->n);
+    o->n = 0;
+  }
+  o->buf[o->n++] = c;
+  if(c == '\n')
+    o->nl = 1;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(struct out *o, int xx, int base, int sgn)
 {
   static char digits[] = "0123456789ABCDEF";
   char buf[16];
@@ -32,33 +72,31 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-printf(int fd, const char *fmt, ...)
+// Only understands %d, %x, %p, %s, %c.
+static void
+format(struct out *o, const char *fmt, uint *ap)
 {
   char *s;
   int c, i, state;
-  uint *ap;
 
   state = 0;
-  ap = (uint*)(void*)&fmt + 1;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
     if(state == 0){
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(o, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, *ap, 10, 1);
+        printint(o, *ap, 10, 1);
         ap++;
       } else if(c == 'x' || c == 'p'){
-        printint(fd, *ap, 16, 0);
+        printint(o, *ap, 16, 0);
         ap++;
       } else if(c == 's'){
         s = (char*)*ap;
@@ -66,20 +104,150 @@ printf(int fd, const char *fmt, ...)
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(o, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, *ap);
+        putc(o, *ap);
         ap++;
       } else if(c == '%'){
-        putc(fd, c);
+        putc(o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(o, '%');
+        putc(o, c);
       }
       state = 0;
     }
   }
 }
+
+static void
+flushall(void)
+{
+  int fd;
+
+  for(fd = 0; fd < NOFILE; fd++)
+    fflush(fd);
+}
+
+// fd is being closed: write out its buffer, and forget how it
+// was buffered, since the number may be reused for another file.
+static void
+closebuf(int fd)
+{
+  if(fd < 0 || fd >= NOFILE)
+    return;
+  fflush(fd);
+  mutex_lock(&fdlock);
+  fdbuf[fd].mode = UNKNOWN;
+  mutex_unlock(&fdlock);
+}
+
+// Return fd's buffer, deciding on first use how to flush it.
+// Caller must hold fdlock.
+static struct fdbuf*
+getbuf(int fd)
+{
+  struct fdbuf *b;
+  struct stat st;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  b = &fdbuf[fd];
+  if(b->mode == UNKNOWN){
+    if(fd == 2)
+      b->mode = UNBUF;
+    else if(fstat(fd, &st) == 0 && st.type == T_DEV)
+      b->mode = LINEBUF;
+    else
+      b->mode = FULLBUF;
+    exitflush = flushall;
+    closeflush = closebuf;
+  }
+  return b;
+}
+
+// Print to the given fd.
+void
+printf(int fd, const char *fmt, ...)
+{
+  struct fdbuf *b;
+  struct out o;
+  char tmp[BUFSIZE];
+
+  mutex_lock(&fdlock);
+  o.fd = fd;
+  o.size = BUFSIZE;
+  o.total = 0;
+  o.nl = 0;
+  if((b = getbuf(fd)) != 0){
+    o.buf = b->buf;
+    o.n = b->n;
+  } else {
+    o.buf = tmp;
+    o.n = 0;
+  }
+  format(&o, fmt, (uint*)(void*)&fmt + 1);
+  if(b == 0 || b->mode == UNBUF || (b->mode == LINEBUF && o.nl)){
+    if(o.n > 0)
+      write(fd, o.buf, o.n);
+    o.n = 0;
+  }
+  if(b)
+    b->n = o.n;
+  mutex_unlock(&fdlock);
+}
+
+// Write out anything printf has buffered for fd.
+void
+fflush(int fd)
+{
+  struct fdbuf *b;
+
+  if(fd < 0 || fd >= NOFILE)
+    return;
+  mutex_lock(&fdlock);
+  b = &fdbuf[fd];
+  if(b->n > 0)
+    write(fd, b->buf, b->n);
+  b->n = 0;
+  mutex_unlock(&fdlock);
+}
+
+// Format into buf, which must be big enough.
+// Returns the length of the string.
+int
+sprintf(char *buf, const char *fmt, ...)
+{
+  struct out o;
+
+  o.fd = -1;
+  o.buf = buf;
+  o.n = 0;
+  o.size = 0x7fffffff;
+  o.total = 0;
+  o.nl = 0;
+  format(&o, fmt, (uint*)(void*)&fmt + 1);
+  buf[o.n] = 0;
+  return o.n;
+}
+
+// Format at most n-1 bytes into buf, and a terminating 0 if n > 0.
+// Returns the length the whole string would have had.
+int
+snprintf(char *buf, int n, const char *fmt, ...)
+{
+  struct out o;
+
+  o.fd = -1;
+  o.buf = buf;
+  o.n = 0;
+  o.size = n > 0 ? n - 1 : 0;
+  o.total = 0;
+  o.nl = 0;
+  format(&o, fmt, (uint*)(void*)&fmt + 1);
+  if(n > 0)
+    buf[o.n] = 0;
+  return o.total;
+}
@@ -5,7 +5,12 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mm.h"
 
 struct {
   struct spinlock lock;
@@ -14,11 +19,18 @@ struct {
 
 static struct proc *initproc;
 
+// Countdown for an idle cpu 0 when no tick is awaited;
+// lapicidle() trims it to what the timer can count.
+#define IDLEFOREVER 0xFFFFFFFF
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void kick(void);
+static void idle(struct cpu*);
+static int reap(int, uint*);
 
 void
 pinit(void)
@@ -126,10 +138,11 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->mm = mmalloc(setupkvm())) == 0 || p->mm->pgdir == 0 ||
+     (p->fdt = fdtalloc()) == 0)
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(p->mm->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->mm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -149,29 +162,51 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
+  kick();
 
   release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
-  struct proc *curproc = myproc();
+  uint sz, osz;
+  struct mm *mm = myproc()->mm;
 
-  sz = curproc->sz;
-  if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+  // Lock out other threads, waiting for any that are using
+  // memory a shrink would free.  If the size changed while
+  // waiting, wait for the new range instead.
+  for(;;){
+    osz = mm->sz;
+    if(n < 0 && (uint)-n > osz)
       return -1;
-  } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(mmlock(mm, n < 0 ? osz + n : osz, osz) < 0)
       return -1;
+    if(mm->sz == osz)
+      break;
+    releasesleep(&mm->lock);
   }
-  curproc->sz = sz;
-  switchuvm(curproc);
-  return 0;
+
+  sz = osz;
+  if(n > 0){
+    if(vmaoverlap(mm, PGROUNDUP(sz), sz + n) ||
+       (sz = allocuvm(mm->pgdir, sz, sz + n)) == 0)
+      goto bad;
+  } else if(n < 0){
+    vmaunmap(mm, sz + n, sz);
+    if((sz = deallocuvm(mm->pgdir, sz, sz + n)) == 0)
+      goto bad;
+    tlbflush(mm);
+  }
+  mm->sz = sz;
+  releasesleep(&mm->lock);
+  return osz;
+
+bad:
+  releasesleep(&mm->lock);
+  return -1;
 }
 
 // Create a new process copying p as the parent.
@@ -180,7 +215,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *curproc = myproc();
 
@@ -190,23 +225,25 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->mm = mmcopy(curproc->mm)) == 0 ||
+     (np->fdt = fdtcopy(curproc->fdt)) == 0){
+    if(np->mm){
+      mmput(np->mm);
+      np->mm = 0;
+    }
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
-  np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  np->ring = curproc->ring;
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -215,6 +252,56 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
+  kick();
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a thread: a new process that shares the current
+// process's memory and open files, and starts by calling
+// fn(arg) on the user stack of size bytes at stack.
+// Returns the new thread's pid; join reaps it when it exits.
+int
+clone(uint fn, uint arg, uint stack, uint size)
+{
+  int pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  sp = stack + size;
+  if(sp < stack || size < sizeof(ustack))
+    return -1;
+  sp = (sp - sizeof(ustack)) & ~3;
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = arg;
+  if(uvmtouch(curproc, sp, sizeof(ustack), 1) < 0)
+    return -1;
+  memmove((void*)sp, ustack, sizeof(ustack));
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->mm = mmdup(curproc->mm);
+  np->fdt = fdtdup(curproc->fdt);
+  np->cwd = idup(curproc->cwd);
+  np->parent = curproc;
+  np->thread = 1;
+  np->ustack = stack;
+  np->ring = 0;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = sp;
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+  kick();
 
   release(&ptable.lock);
 
@@ -224,24 +311,45 @@ fork(void)
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// A process that exits takes its threads with it; a thread
+// that exits leaves only, and its parent calls join().
+// The last thread to leave frees the memory and files.
 void
 exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
+  struct mm *mm;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
+  if(!curproc->thread){
+    acquire(&ptable.lock);
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p != curproc && p->mm == curproc->mm && p != p->mm->execer){
+        p->killed = 1;
+        if(p->state == SLEEPING){
+          p->state = RUNNABLE;
+          kick();
+        }
+      }
     }
+    release(&ptable.lock);
   }
 
+  unpin(curproc);
+  fdtput(curproc->fdt);
+  curproc->fdt = 0;
+
+  // Leave the address space before mmput might free it.
+  mm = curproc->mm;
+  pushcli();
+  curproc->mm = 0;
+  switchkvm();
+  popcli();
+  mmput(mm);
+
   begin_op();
   iput(curproc->cwd);
   end_op();
@@ -249,13 +357,18 @@ exit(void)
 
   acquire(&ptable.lock);
 
+  // A thread in exec might be waiting for this one to leave mm.
+  wakeup1(mm);
+
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
 
-  // Pass abandoned children to init.
+  // Pass abandoned children to init, which reaps
+  // threads with wait() like any other child.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
+      p->thread = 0;
       if(p->state == ZOMBIE)
         wakeup1(initproc);
     }
@@ -267,10 +380,74 @@ exit(void)
   panic("zombie exit");
 }
 
+// Kill the other threads sharing the current process's memory,
+// as exec must before replacing it, and wait until they have
+// all left it.  The thread that calls exec carries on with its
+// own pid.  Returns -1 if the caller was killed meanwhile,
+// as by another thread calling exec at the same time.
+int
+killthreads(void)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
+  int found;
+
+  acquire(&ptable.lock);
+  if(mm->execer == 0)
+    mm->execer = curproc;
+  for(;;){
+    if(curproc->killed || mm->execer != curproc){
+      if(mm->execer == curproc)
+        mm->execer = 0;
+      release(&ptable.lock);
+      return -1;
+    }
+    found = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p != curproc && p->mm == mm){
+        found = 1;
+        p->killed = 1;
+        if(p->state == SLEEPING){
+          p->state = RUNNABLE;
+          kick();
+        }
+      }
+    }
+    if(!found)
+      break;
+    sleep(mm, &ptable.lock);
+  }
+  mm->execer = 0;
+  release(&ptable.lock);
+
+  // Reap this thread's own threads, which exec leaves no one
+  // to join.
+  while(join(0) >= 0)
+    ;
+  return 0;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
 wait(void)
+{
+  return reap(0, 0);
+}
+
+// Wait for a thread this process created with clone to
+// exit and return its pid, and in *stack the stack it was
+// given.  Return -1 if there are none.
+int
+join(uint *stack)
+{
+  return reap(1, stack);
+}
+
+// Wait for a child that is a thread (or not) to exit.
+static int
+reap(int thread, uint *stack)
 {
   struct proc *p;
   int havekids, pid;
@@ -281,19 +458,22 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || p->thread != thread)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
+        if(stack)
+          *stack = p->ustack;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
+        p->thread = 0;
+        p->ustack = 0;
         p->state = UNUSED;
         release(&ptable.lock);
         return pid;
@@ -319,11 +499,14 @@ wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+//  - if a pass finds nothing to run, halt until
+//      an interrupt (see idle).
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -332,6 +515,7 @@ scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
+    ran = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
@@ -349,12 +533,51 @@ scheduler(void)
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
+      ran = 1;
     }
+    // Declare this CPU idle before dropping ptable.lock, so
+    // that whoever makes a process RUNNABLE from now on
+    // knows to kick it.
+    if(!ran)
+      c->idle = 1;
     release(&ptable.lock);
 
+    if(!ran)
+      idle(c);
   }
 }
 
+// Halt an idle CPU until an interrupt arrives, with its periodic
+// tick stopped so that an idle machine does not keep taking timer
+// interrupts.  cpu 0 keeps time, so it arms a countdown to the
+// next time it must turn the timer wheel and then credits the
+// ticks that passed; the other CPUs wait for a device interrupt
+// or a wakeup IPI from kick.
+static void
+idle(struct cpu *c)
+{
+  uint n;
+
+  // With interrupts off, a kick that clears c->idle either
+  // happened already (don't halt) or leaves its IPI pending
+  // until stihlt (halt ends at once).
+  cli();
+  if(!c->idle)
+    return;
+  if(cpuid() == 0){
+    if((n = timernext()) == 0)
+      n = IDLEFOREVER;
+  } else
+    n = 0;
+  lapicidle(n);
+  stihlt();
+  cli();
+  n = lapicresume();
+  c->idle = 0;
+  if(cpuid() == 0)
+    tickskip(n);
+}
+
 // Enter scheduler.  Must hold only ptable.lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -460,8 +683,10 @@ wakeup1(void *chan)
   struct proc *p;
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+    if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
+      kick();
+    }
 }
 
 // Wake up all processes sleeping on chan.
@@ -473,6 +698,116 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan,
+// and return how many.
+int
+wakeupn(void *chan, int n)
+{
+  struct proc *p;
+  int woken;
+
+  woken = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && woken < n; p++){
+    if(p->state == SLEEPING && p->chan == chan){
+      p->state = RUNNABLE;
+      kick();
+      woken++;
+    }
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
+// A process just became RUNNABLE: get an idle CPU to
+// run it, preferring this one if it is idle itself (an
+// interrupt arrived while it was halted).
+// The ptable lock must be held.
+static void
+kick(void)
+{
+  struct cpu *c;
+
+  c = mycpu();
+  if(c->idle){
+    c->idle = 0;
+    return;
+  }
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c->idle){
+      c->idle = 0;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+      return;
+    }
+  }
+}
+
+//PAGEBREAK!
+// Note that p's current system call uses the user memory
+// in [start, end), which other threads must not unmap until
+// it returns (see mmlock).
+void
+pin(struct proc *p, uint start, uint end)
+{
+  acquire(&ptable.lock);
+  if(p->pinhi == 0){
+    p->pinlo = start;
+    p->pinhi = end;
+  } else {
+    if(start < p->pinlo)
+      p->pinlo = start;
+    if(end > p->pinhi)
+      p->pinhi = end;
+  }
+  release(&ptable.lock);
+}
+
+// p's system call is done with user memory.
+void
+unpin(struct proc *p)
+{
+  if(p->pinhi == 0)
+    return;
+  acquire(&ptable.lock);
+  p->pinlo = p->pinhi = 0;
+  wakeup1(p->mm);
+  release(&ptable.lock);
+}
+
+// Lock mm to change it, once no other thread is in a system
+// call using user memory in [start, end), so that the kernel
+// never finds memory it is using unmapped.  Returns -1 if
+// the caller was killed while waiting.
+int
+mmlock(struct mm *mm, uint start, uint end)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+
+  for(;;){
+    acquiresleep(&mm->lock);
+    if(start >= end)
+      return 0;
+    acquire(&ptable.lock);
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p != curproc && p->mm == mm && p->pinlo < end && start < p->pinhi)
+        break;
+    release(&ptable.lock);
+    if(p == &ptable.proc[NPROC])
+      return 0;
+
+    // Wait for p's call to finish, without holding mm->lock,
+    // which p may need meanwhile.
+    releasesleep(&mm->lock);
+    acquire(&ptable.lock);
+    if(p->mm == mm && p->pinlo < end && start < p->pinhi)
+      sleep(mm, &ptable.lock);
+    release(&ptable.lock);
+    if(curproc->killed)
+      return -1;
+  }
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -486,8 +821,10 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
+      if(p->state == SLEEPING){
         p->state = RUNNABLE;
+        kick();
+      }
       release(&ptable.lock);
       return 0;
     }
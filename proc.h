@@ -5,6 +5,8 @@ struct cpu {
   struct taskstate ts;         // Used by x86 to find stack for interrupt
   struct segdesc gdt[NSEGS];   // x86 global descriptor table
   volatile uint started;       // Has the CPU started?
+  volatile int idle;           // Halted with nothing to run?
+  volatile int tlbflush;       // Asked to flush its TLB (see tlbflush)
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
@@ -36,8 +38,7 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  struct mm *mm;               // Address space, shared by threads
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
@@ -46,13 +47,13 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable *fdt;         // Open files, shared by threads
+  struct file *fhold[2];       // Files argfd holds for this call
   struct inode *cwd;           // Current directory
+  uint pinlo, pinhi;           // User memory this call uses (see pin)
+  int thread;                  // Created by clone, reaped by join
+  uint ustack;                 // Stack given to clone
+  uint ring;                   // Ring from ringsetup, or 0
+  int steptf;                  // sysentry cleared the user's FL_TF
   char name[16];               // Process name (debugging)
 };
-
-// Process memory is laid out contiguously, low addresses first:
-//   text
-//   original data and bss
-//   fixed-size stack
-//   expandable heap
@@ -0,0 +1,117 @@
+// Submission and completion rings.
+//
+// A process that does many small I/Os can queue them in a ring
+// in its own memory (see ring.h) and have the kernel run a whole
+// batch with one system call, instead of trapping for each.
+// ringsetup registers the ring; each ringenter runs requests
+// submitted since the last, in order, and posts a completion for
+// each holding what the equivalent system call would have
+// returned.
+//
+// Requests run synchronously, in ringenter on the caller's
+// kernel stack, as the system calls themselves would; what the
+// ring saves is the trap and dispatch for each one.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "ring.h"
+
+// Run one request and return its result.
+static int
+ringop(struct sqe *e)
+{
+  struct file *f;
+  char *path;
+  int r;
+
+  switch(e->op){
+  case RING_NOP:
+    return 0;
+  case RING_OPEN:
+    if(fetchstr(e->addr, &path) < 0)
+      return -1;
+    return fileopen(path, e->len);
+  case RING_CLOSE:
+    return fdclose(e->fd);
+  case RING_READ:
+  case RING_WRITE:
+  case RING_FSYNC:
+    break;
+  default:
+    return -1;
+  }
+
+  if((f = fdget(e->fd)) == 0)
+    return -1;
+  r = -1;
+  if(e->op == RING_FSYNC){
+    // write commits its transaction before it returns,
+    // so there is nothing left to wait for.
+    if(f->type == FD_INODE)
+      r = 0;
+  } else if(e->len >= 0 &&
+            uvmtouch(myproc(), e->addr, e->len, e->op == RING_READ) == 0){
+    if(e->op == RING_READ)
+      r = fileread(f, (char*)e->addr, e->len);
+    else
+      r = filewrite(f, (char*)e->addr, e->len);
+  }
+  fileclose(f);
+  return r;
+}
+
+// Make the ring at addr the current process's, emptying it,
+// or drop the process's ring if addr is 0.
+int
+ringsetup(uint addr)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+
+  if(addr != 0){
+    if(addr % 4 != 0 || uvmtouch(p, addr, sizeof(*r), 1) < 0)
+      return -1;
+    r = (struct ring*)addr;
+    r->sqhead = r->sqtail = 0;
+    r->cqhead = r->cqtail = 0;
+  }
+  p->ring = addr;
+  return 0;
+}
+
+// Run up to n submitted requests, stopping early when there
+// are no more or the completion queue is full.  Returns the
+// number run, or -1 if the process has no ring.
+int
+ringenter(int n)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+  struct sqe e;
+  struct cqe *c;
+  int i, res;
+
+  if(p->ring == 0 || uvmtouch(p, p->ring, sizeof(*r), 1) < 0)
+    return -1;
+  r = (struct ring*)p->ring;
+  for(i = 0; i < n && !p->killed; i++){
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead >= RINGSIZE)
+      break;
+    // Copy the request, which the process can still change.
+    e = r->sq[r->sqhead % RINGSIZE];
+    r->sqhead++;
+    res = ringop(&e);
+    c = &r->cq[r->cqtail % RINGSIZE];
+    c->data = e.data;
+    c->res = res;
+    r->cqtail++;
+  }
+  return i;
+}
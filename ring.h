@@ -0,0 +1,39 @@
+// Submission and completion ring, for running a batch of
+// file system calls with one kernel entry (see ring.c).
+//
+// The process fills in sq entries and advances sqtail; each
+// ringenter runs the submitted requests in order, advancing
+// sqhead, and posts a cq entry for each at cqtail.  The process
+// takes cq entries and advances cqhead.  The indices count up
+// forever and are taken modulo RINGSIZE.
+
+#define RINGSIZE 256
+
+#define RING_NOP    0
+#define RING_READ   1  // read(fd, addr, len)
+#define RING_WRITE  2  // write(fd, addr, len)
+#define RING_OPEN   3  // open(addr, len), len being the mode
+#define RING_CLOSE  4  // close(fd)
+#define RING_FSYNC  5  // wait for fd's writes to reach the disk
+
+struct sqe {
+  int op;
+  int fd;
+  uint addr;       // Buffer, or path for RING_OPEN
+  int len;         // Byte count, or mode for RING_OPEN
+  uint data;       // Copied to the request's cqe
+};
+
+struct cqe {
+  uint data;       // From the sqe
+  int res;         // What the system call would have returned
+};
+
+struct ring {
+  uint sqhead;     // Next sqe the kernel will run
+  uint sqtail;     // Next sqe the process will fill in
+  uint cqhead;     // Next cqe the process will take
+  uint cqtail;     // Next cqe the kernel will post
+  struct sqe sq[RINGSIZE];
+  struct cqe cq[RINGSIZE];
+};
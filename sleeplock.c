@@ -17,17 +17,34 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->class = lockclass(name);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint nsleep;
+  uint64 wait;
+  uint pcs[10];
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  nsleep = 0;
+  wait = 0;
+  if(lk->locked){
+    wait = rdtsc();
+    while (lk->locked) {
+      sleep(lk, &lk->lk);
+      nsleep++;
+    }
+    wait = rdtsc() - wait;
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  if(lk->class){
+    getcallerpcs(&lk, pcs);
+    lockacquired(lk->class, lk->lk.cpu - cpus, nsleep, wait, pcs[0]);
+    lk->tsc = rdtsc();
+  }
   release(&lk->lk);
 }
 
@@ -35,6 +52,8 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if(lk->class)
+    lockreleased(lk->class, lk->lk.cpu - cpus, rdtsc() - lk->tsc);
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);
@@ -6,5 +6,9 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For statistics:
+  struct lockclass *class;
+  uint64 tsc;        // Time stamp counter when acquired.
 };
 
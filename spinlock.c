@@ -8,13 +8,250 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+#define NLOCKCLASS 32
+#define NSITE      64  // call sites profiled per cpu
+
+// Statistics for each lock name, dumped by ^L on the console.
+static struct {
+  uint busy;         // Guards n and the class names.
+  int n;
+  struct lockclass class[NLOCKCLASS];
+} lockstat;
+
+// While profiling, each cpu also records the call sites
+// that had to wait for a lock, in a small hash table.
+struct locksite {
+  struct lockclass *class;
+  uint pc;           // Return address of acquire.
+  uint ncontend;
+  uint64 wait;
+};
+
+static int profiling;
+static struct locksite sites[NCPU][NSITE];
+
+// Return the counters for locks called name, making them
+// if this is the first such lock.  Returns 0 if the table
+// is full, in which case the lock is not counted.
+struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  uint eflags;
+
+  // Not pushcli: kinit1 makes kmem.lock before mpinit,
+  // when mycpu() does not work yet.
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockstat.busy, 1) != 0)
+    pause();
+  for(c = lockstat.class; c < &lockstat.class[lockstat.n]; c++)
+    if(strncmp(c->name, name, 16) == 0)
+      goto found;
+  if(lockstat.n == NLOCKCLASS)
+    c = 0;
+  else {
+    c = &lockstat.class[lockstat.n++];
+    c->name = name;
+  }
+found:
+  xchg(&lockstat.busy, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
+
+// Look for the call site pc of class c in table t.
+// If it is missing and make is set, add it.
+static struct locksite*
+sitelookup(struct locksite *t, struct lockclass *c, uint pc, int make)
+{
+  struct locksite *s;
+  uint h, i;
+
+  h = pc ^ (uint)c;
+  for(i = 0; i < NSITE; i++){
+    s = &t[(h+i) % NSITE];
+    if(s->class == c && s->pc == pc)
+      return s;
+    if(s->class == 0){
+      if(!make)
+        return 0;
+      s->class = c;
+      s->pc = pc;
+      return s;
+    }
+  }
+  return 0;
+}
+
+// Count an acquisition of a lock of class c by cpu id from
+// call site pc, after spins tries and wait cycles of waiting.
+// The caller passes id, which it already knows, to save the
+// cost of another mycpu() on every acquire.
+// Called with interrupts off, holding the lock.
+void
+lockacquired(struct lockclass *c, int id, uint spins, uint64 wait, uint pc)
+{
+  struct lockcount *k;
+  struct locksite *s;
+
+  k = &c->cpu[id];
+  k->nacquire++;
+  if(spins == 0)
+    return;
+  k->ncontend++;
+  k->nspin += spins;
+  k->wait += wait;
+  if(profiling && (s = sitelookup(sites[id], c, pc, 1)) != 0){
+    s->ncontend++;
+    s->wait += wait;
+  }
+}
+
+// Count hold cycles for a lock of class c that cpu id is
+// releasing.  Called with interrupts off.
+void
+lockreleased(struct lockclass *c, int id, uint64 hold)
+{
+  c->cpu[id].hold += hold;
+}
+
+// Convert TSC cycles to microseconds.
+static uint
+tsc2us(uint64 t)
+{
+  uint d;
+
+  d = tscpertick / (1000000/HZ);
+  if(d == 0)
+    return 0;
+  if((t >> 32) >= d)
+    return 0xFFFFFFFF;
+  return divl(t, d);
+}
+
+// Add up the per-cpu counters of class c.
+static void
+locksum(struct lockclass *c, struct lockcount *sum)
+{
+  struct lockcount *k;
+
+  memset(sum, 0, sizeof(*sum));
+  for(k = c->cpu; k < &c->cpu[NCPU]; k++){
+    sum->nacquire += k->nacquire;
+    sum->ncontend += k->ncontend;
+    sum->nspin += k->nspin;
+    sum->wait += k->wait;
+    sum->hold += k->hold;
+  }
+}
+
+// Print the lock statistics to the console.
+// Runs when user types ^L on console.
+// No lock, to avoid wedging a stuck machine further;
+// the counters may be slightly out of date.
+void
+lockdump(void)
+{
+  struct lockclass *c;
+  struct lockcount sum;
+
+  cprintf("lock acquires contended spins wait(us) hold(us)\n");
+  for(c = lockstat.class; c < &lockstat.class[lockstat.n]; c++){
+    locksum(c, &sum);
+    if(sum.nacquire == 0)
+      continue;
+    cprintf("%s %d %d %d %d %d\n", c->name, sum.nacquire, sum.ncontend,
+            sum.nspin, tsc2us(sum.wait), tsc2us(sum.hold));
+  }
+}
+
+// Turn call site profiling on or off.  Turning it on clears
+// all the counters.  Returns whether it was on before.
+// Other cpus may be counting while the counters are
+// cleared, so a few of their updates may be lost.
+int
+lockprof(int on)
+{
+  int i, old;
+
+  old = profiling;
+  profiling = 0;
+  if(on){
+    for(i = 0; i < lockstat.n; i++)
+      memset(lockstat.class[i].cpu, 0, sizeof(lockstat.class[i].cpu));
+    memset(sites, 0, sizeof(sites));
+    profiling = 1;
+  }
+  return old;
+}
+
+// Copy up to n lock statistics to st: first the totals for
+// each lock name, then each profiled call site, merging the
+// per-cpu tables.  Returns the number of entries filled.
+int
+lockstats(struct lockstat *st, int n)
+{
+  struct lockclass *c;
+  struct lockcount sum;
+  struct locksite *s, *t;
+  int i, j, m;
+
+  m = 0;
+  for(c = lockstat.class; c < &lockstat.class[lockstat.n] && m < n; c++){
+    locksum(c, &sum);
+    if(sum.nacquire == 0)
+      continue;
+    safestrcpy(st[m].name, c->name, sizeof(st[m].name));
+    st[m].pc = 0;
+    st[m].nacquire = sum.nacquire;
+    st[m].ncontend = sum.ncontend;
+    st[m].wait = tsc2us(sum.wait);
+    st[m].hold = tsc2us(sum.hold);
+    m++;
+  }
+
+  for(i = 0; i < NCPU; i++){
+    for(s = sites[i]; s < &sites[i][NSITE] && m < n; s++){
+      if(s->class == 0)
+        continue;
+      // Skip sites already merged from an earlier cpu.
+      for(j = 0; j < i; j++)
+        if(sitelookup(sites[j], s->class, s->pc, 0))
+          break;
+      if(j < i)
+        continue;
+      sum.ncontend = s->ncontend;
+      sum.wait = s->wait;
+      for(j = i+1; j < NCPU; j++){
+        if((t = sitelookup(sites[j], s->class, s->pc, 0)) != 0){
+          sum.ncontend += t->ncontend;
+          sum.wait += t->wait;
+        }
+      }
+      safestrcpy(st[m].name, s->class->name, sizeof(st[m].name));
+      st[m].pc = s->pc;
+      st[m].nacquire = 0;
+      st[m].ncontend = sum.ncontend;
+      st[m].wait = tsc2us(sum.wait);
+      st[m].hold = 0;
+      m++;
+    }
+  }
+  return m;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -24,13 +261,25 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, spins;
+  uint64 wait;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xaddl is atomic, so each waiter gets its own ticket.
+  // Waiters only read owner while they spin, which keeps the
+  // cache line shared until the holder releases the lock.
+  ticket = xaddl(&lk->next, 1);
+  spins = 0;
+  wait = 0;
+  if(lk->owner != ticket){
+    wait = rdtsc();
+    for(; lk->owner != ticket; spins++)
+      pause();
+    wait = rdtsc() - wait;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +289,11 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->class){
+    lockacquired(lk->class, lk->cpu - cpus, spins, wait, lk->pcs[0]);
+    lk->tsc = rdtsc();
+  }
 }
 
 // Release the lock.
@@ -49,6 +303,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(lk->class)
+    lockreleased(lk->class, lk->cpu - cpus, rdtsc() - lk->tsc);
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +316,11 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Release the lock by serving the next ticket, equivalent
+  // to lk->owner++.  Only the holder writes owner, so the
+  // increment needs no lock prefix, but it must be a single
+  // store.  A real OS would use C atomics here.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +349,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
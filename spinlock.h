@@ -1,11 +1,33 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire takes the next ticket and waits
+// until owner reaches it, so CPUs get the lock in the order
+// they asked for it.  The lock is free when next == owner.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;  // Next ticket to hand out.
+  volatile uint owner; // Ticket now holding the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For statistics:
+  struct lockclass *class; // Counters shared by locks with this name.
+  uint64 tsc;        // Time stamp counter when acquired.
+};
+
+// Counters for all locks of one name, kept per cpu so that
+// each cpu can update its own without a lock.
+struct lockcount {
+  uint nacquire;     // Number of acquisitions.
+  uint ncontend;     // Acquisitions that had to wait.
+  uint nspin;        // Iterations of the wait loop.
+  uint64 wait;       // TSC cycles spent waiting.
+  uint64 hold;       // TSC cycles the lock was held.
 };
 
+struct lockclass {
+  char *name;
+  struct lockcount cpu[NCPU];
+};
@@ -0,0 +1,115 @@
+// Compare the string and memory functions in ulib.c with
+// the byte-at-a-time loops they replaced, across sizes.
+//   strbench [n]
+// Prints average TSC cycles per call of each, over n calls
+// (default 1000) per size.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define MAXSIZE 4096
+
+char a[MAXSIZE+8], b[MAXSIZE+8];
+uint size;
+volatile uint sink;  // Keeps results from being optimized away.
+
+static void
+bytemove(char *dst, const char *src, uint n)
+{
+  while(n-- > 0)
+    *dst++ = *src++;
+}
+
+static int
+bytecmp(const uchar *s1, const uchar *s2, uint n)
+{
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+static uint
+bytelen(const char *s)
+{
+  int n;
+
+  for(n = 0; s[n]; n++)
+    ;
+  return n;
+}
+
+static char*
+bytechr(const char *s, char c)
+{
+  for(; *s; s++)
+    if(*s == c)
+      return (char*)s;
+  return 0;
+}
+
+static void libmove(void) { memmove(a, b, size); }
+static void oldmove(void) { bytemove(a, b, size); }
+static void libcmp(void) { sink = memcmp(a, b, size); }
+static void oldcmp(void) { sink = bytecmp((uchar*)a, (uchar*)b, size); }
+static void liblen(void) { sink = strlen(a); }
+static void oldlen(void) { sink = bytelen(a); }
+static void libchr(void) { sink = (uint)strchr(a, 'x'); }
+static void oldchr(void) { sink = (uint)bytechr(a, 'x'); }
+
+static struct {
+  char *name;
+  void (*lib)(void);
+  void (*old)(void);
+} funcs[] = {
+  { "memmove", libmove, oldmove },
+  { "memcmp",  libcmp,  oldcmp },
+  { "strlen",  liblen,  oldlen },
+  { "strchr",  libchr,  oldchr },
+};
+
+// Average TSC cycles per call of f over n calls.
+static uint
+cycles(void (*f)(void), int n)
+{
+  uint64 t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    f();
+  return divl(rdtsc() - t0, n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static uint sizes[] = { 8, 64, 512, MAXSIZE };
+  int n, i, j;
+
+  n = argc > 1 ? atoi(argv[1]) : 1000;
+  if(n <= 0){
+    printf(2, "usage: strbench [n]\n");
+    exit();
+  }
+
+  printf(1, "cycles per call, ulib / byte loop\n");
+  for(i = 0; i < sizeof(funcs)/sizeof(funcs[0]); i++){
+    printf(1, "%s:", funcs[i].name);
+    for(j = 0; j < sizeof(sizes)/sizeof(sizes[0]); j++){
+      size = sizes[j];
+      // Equal buffers, and strings of length size without an 'x'.
+      memset(a, 'a', size);
+      memset(b, 'a', size);
+      a[size] = b[size] = 0;
+      printf(1, " %d: %d/%d", size, cycles(funcs[i].lib, n),
+        cycles(funcs[i].old, n));
+    }
+    printf(1, "\n");
+  }
+  exit();
+}
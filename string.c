@@ -1,6 +1,9 @@
 #include "types.h"
 #include "x86.h"
 
+// Nonzero if one of the bytes of word w is zero.
+#define HASZERO(w) (((w) - 0x01010101) & ~(w) & 0x80808080)
+
 void*
 memset(void *dst, int c, uint n)
 {
@@ -19,6 +22,14 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  // A word at a time, if both can be aligned at once,
+  // up to the word that differs.
+  if(((uint)s1 ^ (uint)s2) % 4 == 0){
+    for(; (uint)s1 % 4 && n > 0 && *s1 == *s2; n--)
+      s1++, s2++;
+    for(; n >= 4 && *(uint*)s1 == *(uint*)s2; n -= 4)
+      s1 += 4, s2 += 4;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -28,6 +39,24 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// Copy n bytes upward with rep movs.  Whole words are moved
+// only if dst and src can both be aligned, that is, if they
+// differ by a multiple of 4.  Safe when dst is below src.
+static void
+copyup(char *d, const char *s, uint n)
+{
+  uint m;
+
+  if(((uint)d ^ (uint)s) % 4 == 0 && n >= 8){
+    m = -(uint)d % 4;
+    movsb(d, s, m);
+    d += m, s += m, n -= m;
+    movsl(d, s, n/4);
+    d += n & ~3, s += n & ~3, n %= 4;
+  }
+  movsb(d, s, n);
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
@@ -39,11 +68,16 @@ memmove(void *dst, const void *src, uint n)
   if(s < d && s + n > d){
     s += n;
     d += n;
-    while(n-- > 0)
-      *--d = *--s;
+    if(((uint)s | (uint)d | n) % 4 == 0)
+      for(; n > 0; n -= 4){
+        s -= 4, d -= 4;
+        *(uint*)d = *(uint*)s;
+      }
+    else
+      while(n-- > 0)
+        *--d = *--s;
   } else
-    while(n-- > 0)
-      *d++ = *s++;
+    copyup(d, s, n);
 
   return dst;
 }
@@ -52,7 +86,8 @@ memmove(void *dst, const void *src, uint n)
 void*
 memcpy(void *dst, const void *src, uint n)
 {
-  return memmove(dst, src, n);
+  copyup(dst, src, n);
+  return dst;
 }
 
 int
@@ -93,13 +128,21 @@ safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
+// Once p is aligned, look for the 0 a word at a time.  An
+// aligned word never crosses a page, so reading the bytes
+// after the 0 cannot fault.
 int
 strlen(const char *s)
 {
-  int n;
-
-  for(n = 0; s[n]; n++)
-    ;
-  return n;
+  const char *p;
+
+  for(p = s; (uint)p % 4; p++)
+    if(*p == 0)
+      return p - s;
+  while(!HASZERO(*(uint*)p))
+    p += 4;
+  while(*p)
+    p++;
+  return p - s;
 }
 
@@ -17,9 +17,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(uvmtouch(myproc(), addr, 4, 0) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -31,18 +29,16 @@ fetchint(uint addr, int *ip)
 int
 fetchstr(uint addr, char **pp)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  char *s;
 
-  if(addr >= curproc->sz)
-    return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
+  for(s = *pp; ; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) &&
+       uvmtouch(myproc(), (uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
-  return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -54,16 +50,31 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space, and fault the
+// memory in so the kernel can read it.
 int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || uvmtouch(myproc(), i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, for a block of memory that the kernel will
+// write: also check that the memory is writable.
+int
+argout(int n, char **pp, int size)
+{
+  int i;
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(size < 0 || uvmtouch(myproc(), i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +82,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (The string can change between this check and being used by
+// the kernel only if it is in memory shared with mmap or with
+// another thread, which callers are trusted not to do.)
 int
 argstr(int n, char **pp)
 {
@@ -103,6 +115,29 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_nanosleep(void);
+extern int sys_clock_gettime(void);
+extern int sys_date(void);
+extern int sys_lockprof(void);
+extern int sys_lockstat(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_fcntl(void);
+extern int sys_splice(void);
+extern int sys_poll(void);
+extern int sys_pipe2(void);
+extern int sys_ringsetup(void);
+extern int sys_ringenter(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_getdents(void);
+extern int sys_fstatat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,12 +161,35 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_date]    sys_date,
+[SYS_lockprof] sys_lockprof,
+[SYS_lockstat] sys_lockstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_fcntl]   sys_fcntl,
+[SYS_splice]  sys_splice,
+[SYS_poll]    sys_poll,
+[SYS_pipe2]   sys_pipe2,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_getdents] sys_getdents,
+[SYS_fstatat] sys_fstatat,
 };
 
 void
 syscall(void)
 {
-  int num;
+  int num, i;
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
@@ -142,4 +200,14 @@ syscall(void)
             curproc->pid, curproc->name, num);
     curproc->tf->eax = -1;
   }
+
+  // Let go of what the call kept other threads from
+  // closing or unmapping (see argfd and uvmtouch).
+  for(i = 0; i < NELEM(curproc->fhold); i++){
+    if(curproc->fhold[i]){
+      fileclose(curproc->fhold[i]);
+      curproc->fhold[i] = 0;
+    }
+  }
+  unpin(curproc);
 }
@@ -20,3 +20,26 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_nanosleep 22
+#define SYS_clock_gettime 23
+#define SYS_date 24
+#define SYS_lockprof 25
+#define SYS_lockstat 26
+#define SYS_mmap   27
+#define SYS_munmap 28
+#define SYS_clone  29
+#define SYS_join   30
+#define SYS_futex_wait 31
+#define SYS_futex_wake 32
+#define SYS_fcntl  33
+#define SYS_splice 34
+#define SYS_poll   35
+#define SYS_pipe2  36
+#define SYS_ringsetup 37
+#define SYS_ringenter 38
+#define SYS_readv  39
+#define SYS_writev 40
+#define SYS_pread  41
+#define SYS_pwrite 42
+#define SYS_getdents 43
+#define SYS_fstatat 44
@@ -0,0 +1,54 @@
+// Compare the cost of a getpid() round trip through the
+// sysenter fast path and through int $T_SYSCALL.
+//   syscallbench [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "memlayout.h"
+#include "syscall.h"
+#include "traps.h"
+
+// getpid() the old way, whatever usys.S would use.
+static int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid) : "memory");
+  return pid;
+}
+
+// Average TSC cycles per call of f over n calls.
+static uint
+cycles(int (*f)(void), int n)
+{
+  uint64 t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    f();
+  return divl(rdtsc() - t0, n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = argc > 1 ? atoi(argv[1]) : 100000;
+  if(n <= 0){
+    printf(2, "usage: syscallbench [n]\n");
+    exit();
+  }
+  if(!*(uint*)SYSENTEROK)
+    printf(1, "syscallbench: no sysenter, both use int\n");
+  intgetpid();
+  getpid();
+  printf(1, "int $%d: %d cycles\n", T_SYSCALL, cycles(intgetpid, n));
+  printf(1, "sysenter: %d cycles\n", cycles(getpid, n));
+  exit();
+}
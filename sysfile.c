@@ -15,18 +15,40 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
+#include "mm.h"
+#include "poll.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// If other threads share the descriptor table, one of them could
+// close the file while this call uses it, so hold a reference to
+// it until the call returns (see syscall).
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
-  int fd;
+  int fd, i;
   struct file *f;
+  struct proc *curproc = myproc();
+  struct fdtable *t = curproc->fdt;
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&t->lock);
+  if((f = t->ofile[fd]) != 0 && t->ref > 1){
+    for(i = 0; i < NELEM(curproc->fhold); i++)
+      if(curproc->fhold[i] == 0)
+        break;
+    if(i < NELEM(curproc->fhold))
+      curproc->fhold[i] = filedup(f);
+    else
+      f = 0;
+  }
+  release(&t->lock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -41,14 +63,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct fdtable *t = myproc()->fdt;
 
+  acquire(&t->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(t->ofile[fd] == 0){
+      t->ofile[fd] = f;
+      release(&t->lock);
       return fd;
     }
   }
+  release(&t->lock);
   return -1;
 }
 
@@ -60,9 +85,11 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
-    return -1;
   filedup(f);
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -73,7 +100,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argout(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -90,30 +117,234 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the iovec array argument n, of cnt entries, into iov,
+// checking each buffer like argptr, or like argout if write.
+static int
+argiov(int n, int cnt, struct iovec *iov, int write)
+{
+  struct iovec *uiov;
+  int i;
+
+  if(cnt < 0 || cnt > IOV_MAX ||
+     argptr(n, (void*)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(*uiov));
+  for(i = 0; i < cnt; i++)
+    if(iov[i].len < 0 ||
+       uvmtouch(myproc(), (uint)iov[i].base, iov[i].len, write) < 0)
+      return -1;
+  return 0;
+}
+
+// Read into several buffers with one call.
 int
-sys_close(void)
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, n, iov, 1) < 0)
+    return -1;
+  return filereadv(f, iov, n, -1);
+}
+
+// Write several buffers with one call.
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, n, iov, 0) < 0)
+    return -1;
+  return filewritev(f, iov, n, -1);
+}
+
+// Read at a given offset, leaving the file's offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 || argint(3, &off) < 0 ||
+     argout(1, (void*)&iov.base, iov.len) < 0 || off < 0)
+    return -1;
+  return filereadv(f, &iov, 1, off);
+}
+
+// Write at a given offset, leaving the file's offset alone.
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 || argint(3, &off) < 0 ||
+     argptr(1, (void*)&iov.base, iov.len) < 0 || off < 0)
+    return -1;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Close file descriptor fd of the current process.
+int
+fdclose(int fd)
 {
-  int fd;
   struct file *f;
+  struct fdtable *t = myproc()->fdt;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&t->lock);
+  f = t->ofile[fd];
+  t->ofile[fd] = 0;
+  release(&t->lock);
+  if(f == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+int
+sys_close(void)
+{
+  int fd;
+
+  if(argint(0, &fd) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
+// Move n bytes from one file to another without copying
+// them through user memory.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// Register a submission and completion ring (see ring.c).
+int
+sys_ringsetup(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return ringsetup(addr);
+}
+
+// Run a batch of requests from the ring.
+int
+sys_ringenter(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return ringenter(n);
+}
+
+// Wait for any of several files to become ready.
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  int nfds, timeout;
+
+  if(argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE ||
+     argout(0, (void*)&fds, nfds*sizeof(*fds)) < 0)
+    return -1;
+  return poll(fds, nfds, timeout);
+}
+
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETPIPE_SZ:
+  case F_SETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipesize(f->pipe, cmd == F_SETPIPE_SZ ? arg : 0);
+  case F_GETFL:
+    return (f->readable ? (f->writable ? O_RDWR : O_RDONLY) : O_WRONLY) |
+      (f->nonblock ? O_NONBLOCK : 0) | (f->direct ? O_DIRECT : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    f->direct = (arg & O_DIRECT) != 0;
+    return 0;
+  }
+  return -1;
+}
+
 int
 sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argout(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
 
+// Read the entries of a directory, many at a time.
+int
+sys_getdents(void)
+{
+  struct file *f;
+  int n;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argout(1, &p, n) < 0)
+    return -1;
+  return filegetdents(f, p, n);
+}
+
+// Get metadata about the file at path, relative to the
+// directory open as the first argument.
+int
+sys_fstatat(void)
+{
+  struct file *f;
+  char *path;
+  struct stat *st;
+  struct inode *ip;
+
+  if(argfd(0, 0, &f) < 0 || argstr(1, &path) < 0 ||
+     argout(2, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  begin_op();
+  if((ip = nameiat(f->ip, path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  stati(ip, st);
+  iunlockput(ip);
+  end_op();
+  return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -283,17 +514,15 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
+// Open path with mode omode and return a file descriptor
+// for it, or -1.
 int
-sys_open(void)
+fileopen(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   begin_op();
 
   if(omode & O_CREATE){
@@ -308,31 +537,46 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & (O_WRONLY|O_RDWR))){
       iunlockput(ip);
       end_op();
       return -1;
     }
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
     return -1;
   }
-  iunlock(ip);
-  end_op();
-
+  // Fill in f before fdalloc makes it visible to other threads.
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
+  f->direct = (omode & O_DIRECT) != 0;
+  iunlock(ip);
+  end_op();
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return fileopen(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -420,26 +664,124 @@ sys_exec(void)
   return exec(path, argv);
 }
 
-int
-sys_pipe(void)
+// Make a pipe and store its read and write descriptors in fd.
+// flags may include O_NONBLOCK.
+static int
+mkpipe(int *fd, int flags)
 {
-  int *fd;
   struct file *rf, *wf;
+  struct fdtable *t = myproc()->fdt;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
-    return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+  rf->nonblock = wf->nonblock = (flags & O_NONBLOCK) != 0;
+  // Find both slots before filling either, so another thread
+  // never sees a descriptor that may yet be taken back.
+  acquire(&t->lock);
+  for(fd0 = 0; fd0 < NOFILE && t->ofile[fd0]; fd0++)
+    ;
+  for(fd1 = fd0 + 1; fd1 < NOFILE && t->ofile[fd1]; fd1++)
+    ;
+  if(fd1 >= NOFILE){
+    release(&t->lock);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
+  t->ofile[fd0] = rf;
+  t->ofile[fd1] = wf;
+  release(&t->lock);
   fd[0] = fd0;
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_pipe(void)
+{
+  int *fd;
+
+  if(argout(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+    return -1;
+  return mkpipe(fd, 0);
+}
+
+int
+sys_pipe2(void)
+{
+  int *fd, flags;
+
+  if(argout(0, (void*)&fd, 2*sizeof(fd[0])) < 0 || argint(1, &flags) < 0)
+    return -1;
+  return mkpipe(fd, flags);
+}
+
+// Map part of a file into memory.  The address argument is
+// ignored: the kernel picks the address.
+int
+sys_mmap(void)
+{
+  int len, prot, flags, off, vflags, addr;
+  struct file *f;
+  struct inode *ip;
+  struct mm *mm;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+
+  vflags = 0;
+  if(prot & PROT_WRITE)
+    vflags |= VMA_WRITE;
+  if(flags & MAP_SHARED)
+    vflags |= VMA_SHARED;
+
+  ip = 0;
+  if(!(flags & MAP_ANONYMOUS)){
+    if(argfd(4, 0, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    ilock(f->ip);
+    if(f->ip->type != T_FILE){
+      iunlock(f->ip);
+      return -1;
+    }
+    iunlock(f->ip);
+    if((vflags & (VMA_SHARED|VMA_WRITE)) == (VMA_SHARED|VMA_WRITE) &&
+       !f->writable)
+      return -1;
+    ip = f->ip;
+  }
+
+  mm = myproc()->mm;
+  if(mmlock(mm, 0, 0) < 0)
+    return -1;
+  addr = vmamap(mm, ip, off, len, vflags);
+  releasesleep(&mm->lock);
+  return addr;
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len, r;
+  struct mm *mm;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  if(addr % PGSIZE != 0)
+    return -1;
+  mm = myproc()->mm;
+  if(mmlock(mm, addr, addr + len) < 0)
+    return -1;
+  r = vmaunmap(mm, addr, addr + len);
+  releasesleep(&mm->lock);
+  return r;
+}
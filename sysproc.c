@@ -2,6 +2,7 @@
 #include "x86.h"
 #include "defs.h"
 #include "date.h"
+#include "lockstat.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
@@ -26,6 +27,47 @@ sys_wait(void)
   return wait();
 }
 
+int
+sys_clone(void)
+{
+  int fn, arg, stack, size;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 ||
+     argint(2, &stack) < 0 || argint(3, &size) < 0)
+    return -1;
+  return clone(fn, arg, stack, size);
+}
+
+int
+sys_join(void)
+{
+  uint *stack;
+
+  if(argout(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
 int
 sys_kill(void)
 {
@@ -45,36 +87,33 @@ sys_getpid(void)
 int
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
-  return addr;
+  return growproc(n);
 }
 
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return timersleep(n);
+}
+
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  return nsleep(ts->sec, ts->nsec);
 }
 
 // return how many clock tick interrupts have occurred
@@ -89,3 +128,49 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+int
+sys_clock_gettime(void)
+{
+  int which;
+  struct timespec *ts;
+
+  if(argint(0, &which) < 0 || argout(1, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  return clockread(which, ts);
+}
+
+// Read the date from the CMOS clock.
+int
+sys_date(void)
+{
+  struct rtcdate *r;
+
+  if(argout(0, (void*)&r, sizeof(*r)) < 0)
+    return -1;
+  cmostime(r);
+  return 0;
+}
+
+// Turn lock profiling on or off.
+int
+sys_lockprof(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return lockprof(on);
+}
+
+int
+sys_lockstat(void)
+{
+  struct lockstat *st;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > 4096 ||
+     argout(0, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return lockstats(st, n);
+}
@@ -0,0 +1,326 @@
+// Kernel timers.
+//
+// A timer wakes up the processes sleeping on it once ticks
+// reaches t->expires.  Pending timers hang off a hierarchical
+// timing wheel: the first level has one slot for each of the next
+// WHEELSIZE ticks, each further level has slots WHEELSIZE times
+// as wide, and when the first level wraps around, the next slot
+// of the level above is emptied ("cascaded") into the levels below.
+// Adding or removing a timer is O(1), and each tick looks only at
+// the timers due on it, instead of waking every sleeper to
+// recheck its deadline.
+//
+// The wheel is protected by tickslock, and turned by cpu 0
+// as it advances ticks (see trap.c).
+//
+// This file also keeps the clock: the TSC, calibrated at boot
+// (see lapic.c), counts nanoseconds, and the CMOS clock read at
+// boot gives the date.  The conversion factors live on a page
+// that every process can read (see struct clockdata).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "date.h"
+#include "timer.h"
+
+#define WHEELBITS  6
+#define WHEELSIZE  (1<<WHEELBITS)
+#define WHEELMASK  (WHEELSIZE-1)
+#define NLEVEL     4
+#define MAXDELAY   ((1<<(WHEELBITS*NLEVEL)) - 1)
+
+static struct {
+  uint now;       // Next tick to turn the wheel for
+  int npending;   // Number of timers on the wheel
+  struct timer *slot[NLEVEL][WHEELSIZE];
+} wheel;
+
+uint tscpertick;  // TSC cycles per tick
+
+// The page mapped at CLOCKPAGE in every process.
+__attribute__((__aligned__(PGSIZE)))
+char clockpage[PGSIZE];
+#define clock ((struct clockdata*)clockpage)
+
+// Seconds from 1970 to the given date.
+static uint
+epochsecs(struct rtcdate *r)
+{
+  static ushort mdays[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+  uint y, days;
+
+  days = 0;
+  for(y = 1970; y < r->year; y++)
+    days += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
+  days += mdays[r->month - 1] + r->day - 1;
+  y = r->year;
+  if(r->month > 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))
+    days++;
+  return ((days*24 + r->hour)*60 + r->minute)*60 + r->second;
+}
+
+void
+timerinit(void)
+{
+  struct rtcdate r;
+  uint shift;
+
+  tscpertick = lapictsc();
+
+  // Pick the largest shift (most precision) for which
+  // mult = (nanoseconds per tick << shift) / tscpertick
+  // still fits in 32 bits.
+  for(shift = 32; shift > 0; shift--)
+    if((((uint64)(1000000000/HZ) << shift) >> 32) < tscpertick)
+      break;
+  clock->mult = divl((uint64)(1000000000/HZ) << shift, tscpertick);
+  clock->shift = shift;
+  cmostime(&r);
+  clock->boottime = epochsecs(&r);
+  clock->tsc0 = rdtsc();
+  if((char*)&clock->sysenter - clockpage != SYSENTEROK - CLOCKPAGE)
+    panic("timerinit: SYSENTEROK");
+  clock->sysenter = sysenterok;
+}
+
+// Read the given clock into ts.  Returns -1 for an unknown clock.
+int
+clockread(int which, struct timespec *ts)
+{
+  uint64 d, ns;
+  uint sec;
+
+  if(which != CLOCK_REALTIME && which != CLOCK_MONOTONIC)
+    return -1;
+  d = rdtsc() - clock->tsc0;
+  ns = (((uint64)(uint)d * clock->mult) >> clock->shift) +
+       (((uint64)(uint)(d >> 32) * clock->mult) << (32 - clock->shift));
+  sec = divl(ns, 1000000000);
+  ts->nsec = ns - (uint64)sec * 1000000000;
+  ts->sec = sec;
+  if(which == CLOCK_REALTIME)
+    ts->sec += clock->boottime;
+  return 0;
+}
+
+// Hang t on the slot that covers t->expires.
+static void
+enqueue(struct timer *t)
+{
+  struct timer **head;
+  uint delta, e;
+  int lvl;
+
+  e = t->expires;
+  delta = e - wheel.now;
+  if((int)delta < 0){
+    // Overdue: fire on the next turn.
+    e = wheel.now;
+    delta = 0;
+  } else if(delta > MAXDELAY){
+    // Beyond the last level: park at the horizon, to be
+    // cascaded and placed again as time goes by.
+    e = wheel.now + MAXDELAY;
+    delta = MAXDELAY;
+  }
+  for(lvl = 0; lvl < NLEVEL-1; lvl++)
+    if(delta < 1 << (WHEELBITS*(lvl+1)))
+      break;
+  head = &wheel.slot[lvl][(e >> (WHEELBITS*lvl)) & WHEELMASK];
+  t->next = *head;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+// Take t off its slot.
+static void
+dequeue(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+}
+
+// Empty a slot of a level above the first into the levels below.
+static void
+cascade(int lvl, uint idx)
+{
+  struct timer *t, *next;
+
+  t = wheel.slot[lvl][idx];
+  wheel.slot[lvl][idx] = 0;
+  for(; t; t = next){
+    next = t->next;
+    enqueue(t);
+  }
+}
+
+// Fire the timers due at tick wheel.now and move on to the next.
+static void
+turn(void)
+{
+  struct timer *t, *next;
+  uint idx;
+  int lvl;
+
+  idx = wheel.now & WHEELMASK;
+  for(lvl = 1; idx == 0 && lvl < NLEVEL; lvl++){
+    idx = (wheel.now >> (WHEELBITS*lvl)) & WHEELMASK;
+    cascade(lvl, idx);
+  }
+
+  idx = wheel.now & WHEELMASK;
+  t = wheel.slot[0][idx];
+  wheel.slot[0][idx] = 0;
+  for(; t; t = next){
+    next = t->next;
+    t->pending = 0;
+    wheel.npending--;
+    wakeup(t);
+  }
+  wheel.now++;
+}
+
+// Fire all timers that have come due.
+// Called by cpu 0 after advancing ticks, with tickslock held.
+void
+timerexpire(void)
+{
+  clock->ticks = ticks;
+  while((int)(ticks - wheel.now) >= 0)
+    turn();
+}
+
+// Arrange for t to fire when ticks reaches expires.
+// Caller must hold tickslock.
+void
+timeradd(struct timer *t, uint expires)
+{
+  if(!holding(&tickslock))
+    panic("timeradd");
+  t->expires = expires;
+  if((int)(expires - ticks) <= 0){
+    t->pending = 0;
+    return;
+  }
+  t->pending = 1;
+  wheel.npending++;
+  enqueue(t);
+
+  // An idle cpu 0 may have armed its countdown
+  // beyond this expiry; get it to rearm.
+  if(cpus[0].idle && mycpu() != &cpus[0])
+    lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_WAKEUP);
+}
+
+// Cancel t if it has not fired yet.
+// Caller must hold tickslock.
+void
+timerdel(struct timer *t)
+{
+  if(!holding(&tickslock))
+    panic("timerdel");
+  if(!t->pending)
+    return;
+  dequeue(t);
+  t->pending = 0;
+  wheel.npending--;
+}
+
+// Return the number of ticks until cpu 0 next has to turn the
+// wheel, or 0 if no timer is pending.  An idle cpu 0 arms its
+// countdown with this (see idle in proc.c).
+uint
+timernext(void)
+{
+  uint i, n;
+
+  acquire(&tickslock);
+  if(wheel.npending == 0){
+    release(&tickslock);
+    return 0;
+  }
+  for(i = 0; i < WHEELSIZE; i++){
+    // Stop at the next cascade, or at the first timer
+    // due before it.
+    if(((wheel.now + i) & WHEELMASK) == 0)
+      break;
+    if(wheel.slot[0][(wheel.now + i) & WHEELMASK])
+      break;
+  }
+  n = wheel.now + i - ticks;
+  release(&tickslock);
+  if((int)n < 1)
+    n = 1;
+  return n;
+}
+
+// Sleep for n ticks.  Returns -1 if the process is killed first.
+int
+timersleep(uint n)
+{
+  struct timer t;
+
+  acquire(&tickslock);
+  timeradd(&t, ticks + n);
+  while(t.pending){
+    if(myproc()->killed){
+      timerdel(&t);
+      release(&tickslock);
+      return -1;
+    }
+    sleep(&t, &tickslock);
+  }
+  release(&tickslock);
+  return 0;
+}
+
+// Sleep for sec seconds and nsec nanoseconds.  Whole ticks are
+// slept on the wheel; the wheel cannot fire between ticks, so the
+// last fraction of a tick is waited out by yielding the CPU until
+// the TSC says it has passed, which gives microsecond resolution.
+// Returns -1 if the process is killed first.
+int
+nsleep(uint sec, uint nsec)
+{
+  uint64 end, now, left;
+  uint n, tscperus;
+
+  if(nsec >= 1000000000)
+    return -1;
+  if(tscpertick == 0){
+    // No TSC to measure with: round up to whole ticks.
+    return timersleep(sec*HZ + (nsec + 1000000000/HZ - 1) / (1000000000/HZ));
+  }
+
+  tscperus = tscpertick / (1000000/HZ);
+  end = rdtsc() + (uint64)sec * tscpertick * HZ + (uint64)(nsec/1000) * tscperus;
+  for(;;){
+    if(myproc()->killed)
+      return -1;
+    now = rdtsc();
+    if(now >= end)
+      return 0;
+    left = end - now;
+    if(left >= tscpertick){
+      // Sleeping n ticks returns within n ticks' time, however
+      // far into the current tick we are.
+      if(left >> 32)
+        n = 0xFFFFFFFF / tscpertick;
+      else
+        n = (uint)left / tscpertick;
+      if(timersleep(n) < 0)
+        return -1;
+    } else
+      yield();
+  }
+}
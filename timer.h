@@ -0,0 +1,7 @@
+// Kernel timer, see timer.c.
+struct timer {
+  uint expires;          // Value of ticks at which to fire
+  int pending;           // Waiting on the timing wheel?
+  struct timer *next;    // Timing wheel slot list
+  struct timer **pprev;  // Link that points at this timer
+};
@@ -11,6 +11,9 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysentry(void);  // in trapasm.S
+extern void sysentryfl(void);
+int sysenterok;  // Do the cpus have sysenter?
 struct spinlock tickslock;
 uint ticks;
 
@@ -22,21 +25,57 @@ tvinit(void)
   for(i = 0; i < 256; i++)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
+  sysenterok = (cpufeatures() & CPUID_SEP) != 0;
 
   initlock(&tickslock, "time");
 }
 
+// Load the idt, and set this cpu up for the sysenter fast
+// path to system calls (see sysentry in trapasm.S).  sysenter
+// takes its kernel stack from an MSR rather than the task
+// state, so switchuvm sets that one for each process.
 void
 idtinit(void)
 {
   lidt(idt, sizeof(idt));
+  if(sysenterok){
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+    wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  }
+}
+
+// Account for n ticks that went by on cpu 0 while its
+// periodic timer was stopped (see idle in proc.c).
+void
+tickskip(uint n)
+{
+  if(n == 0)
+    return;
+  acquire(&tickslock);
+  ticks += n;
+  timerexpire();
+  release(&tickslock);
 }
 
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  // sysenter with FL_TF set traps at the top of sysentry,
+  // before the user's eflags are saved.  Clear it, and set
+  // it again in the frame for the system call's return.
+  if(tf->trapno == T_DEBUG && (tf->cs&3) == 0 &&
+     tf->eip >= (uint)sysentry && tf->eip <= (uint)sysentryfl){
+    tf->eflags &= ~FL_TF;
+    myproc()->steptf = 1;
+    return;
+  }
+
   if(tf->trapno == T_SYSCALL){
+    if(myproc()->steptf){
+      tf->eflags |= FL_TF;
+      myproc()->steptf = 0;
+    }
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
@@ -51,11 +90,22 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
+      timerexpire();
       release(&tickslock);
     }
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_TLB:
+    // Clear the request first: a request made after this
+    // is either covered by the flush or sends another IPI.
+    mycpu()->tlbflush = 0;
+    lcr3(rcr3());
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Nothing to do: the interrupt itself got this CPU out of hlt.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -78,6 +128,13 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A user page of a vma, not yet filled in?
+    if(myproc() && (tf->cs&3) == DPL_USER &&
+       pagefault(myproc(), rcr2(), tf->err & FEC_WR) == 0)
+      break;
+    // Otherwise a bad address: fall through.
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
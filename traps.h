@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_TLB         29      // IPI to flush a CPU's TLB (see tlbflush)
+#define IRQ_WAKEUP      30      // IPI to get an idle CPU out of hlt
 #define IRQ_SPURIOUS    31
 
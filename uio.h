@@ -0,0 +1,7 @@
+// One buffer of a vectored read or write (readv, writev).
+struct iovec {
+  void *base;
+  int len;
+};
+
+#define IOV_MAX 16  // Most buffers one call can take
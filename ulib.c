@@ -3,6 +3,13 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "date.h"
+#include "mmu.h"
+#include "memlayout.h"
+#include "param.h"
+
+// Nonzero if one of the bytes of word w is zero.
+#define HASZERO(w) (((w) - 0x01010101) & ~(w) & 0x80808080)
 
 char*
 strcpy(char *s, const char *t)
@@ -23,26 +30,52 @@ strcmp(const char *p, const char *q)
   return (uchar)*p - (uchar)*q;
 }
 
+// Once aligned, strlen and strchr read a word at a time.
+// An aligned word never crosses a page, so reading the bytes
+// after the 0 cannot fault.
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p;
 
-  for(n = 0; s[n]; n++)
-    ;
-  return n;
+  for(p = s; (uint)p % 4; p++)
+    if(*p == 0)
+      return p - s;
+  while(!HASZERO(*(uint*)p))
+    p += 4;
+  while(*p)
+    p++;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  if ((int)dst%4 == 0 && n%4 == 0){
+    c &= 0xFF;
+    stosl(dst, (c<<24)|(c<<16)|(c<<8)|c, n/4);
+  } else
+    stosb(dst, c, n);
   return dst;
 }
 
 char*
 strchr(const char *s, char c)
 {
+  uint w, cc;
+
+  for(; (uint)s % 4; s++){
+    if(*s == 0)
+      return 0;
+    if(*s == c)
+      return (char*)s;
+  }
+  cc = (uchar)c * 0x01010101;
+  for(;; s += 4){
+    w = *(uint*)s;
+    if(HASZERO(w) || HASZERO(w ^ cc))
+      break;
+  }
   for(; *s; s++)
     if(*s == c)
       return (char*)s;
@@ -92,15 +125,320 @@ atoi(const char *s)
   return n;
 }
 
+// Copy n bytes upward with rep movs, a word at a time if
+// dst and src differ by a multiple of 4.
+static void
+copyup(char *d, const char *s, uint n)
+{
+  uint m;
+
+  if(((uint)d ^ (uint)s) % 4 == 0 && n >= 8){
+    m = -(uint)d % 4;
+    movsb(d, s, m);
+    d += m, s += m, n -= m;
+    movsl(d, s, n/4);
+    d += n & ~3, s += n & ~3, n %= 4;
+  }
+  movsb(d, s, n);
+}
+
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
   char *dst;
   const char *src;
 
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
-  while(n-- > 0)
-    *dst++ = *src++;
+  if(src < dst && src + n > dst){
+    src += n;
+    dst += n;
+    if(((uint)src | (uint)dst | n) % 4 == 0)
+      for(; n > 0; n -= 4){
+        src -= 4, dst -= 4;
+        *(uint*)dst = *(uint*)src;
+      }
+    else
+      while(n-- > 0)
+        *--dst = *--src;
+  } else
+    copyup(dst, src, n);
   return vdst;
 }
+
+void*
+memcpy(void *dst, const void *src, uint n)
+{
+  copyup(dst, src, n);
+  return dst;
+}
+
+int
+memcmp(const void *v1, const void *v2, uint n)
+{
+  const uchar *s1, *s2;
+
+  s1 = v1;
+  s2 = v2;
+  if(((uint)s1 ^ (uint)s2) % 4 == 0){
+    for(; (uint)s1 % 4 && n > 0 && *s1 == *s2; n--)
+      s1++, s2++;
+    for(; n >= 4 && *(uint*)s1 == *(uint*)s2; n -= 4)
+      s1 += 4, s2 += 4;
+  }
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+// Like clock_gettime(), but computed from the clock data page
+// the kernel maps at CLOCKPAGE, without a system call.
+int
+clocknow(int which, struct timespec *ts)
+{
+  struct clockdata *c = (struct clockdata*)CLOCKPAGE;
+  uint64 d, ns;
+  uint sec;
+
+  if(which != CLOCK_REALTIME && which != CLOCK_MONOTONIC)
+    return -1;
+  d = rdtsc() - c->tsc0;
+  ns = (((uint64)(uint)d * c->mult) >> c->shift) +
+       (((uint64)(uint)(d >> 32) * c->mult) << (32 - c->shift));
+  sec = divl(ns, 1000000000);
+  ts->nsec = ns - (uint64)sec * 1000000000;
+  ts->sec = sec;
+  if(which == CLOCK_REALTIME)
+    ts->sec += c->boottime;
+  return 0;
+}
+
+// Spin locks for threads sharing memory.  A zeroed lock is
+// unlocked.
+void
+lock_acquire(struct lock *lk)
+{
+  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+    pause();
+}
+
+void
+lock_release(struct lock *lk)
+{
+  __sync_lock_release(&lk->locked);
+}
+
+// Mutexes, condition variables and barriers, which sleep
+// in the kernel with futex_wait instead of spinning.  Each
+// enters the kernel only when it has to wait or has waiters
+// to wake.  A zeroed mutex or cond is ready to use.
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // Contended: mark the mutex as having waiters, so that
+  // unlock wakes one, and sleep until it is free.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    futex_wake(&m->state, 1);
+  }
+}
+
+// Atomically unlock m and wait for cond_signal or
+// cond_broadcast on c, then lock m again.  As with any
+// condition variable, the caller must recheck its condition.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  // Others may be waiting for m too; keep it marked.
+  while(__sync_lock_test_and_set(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, NPROC);
+}
+
+void
+barrier_init(struct barrier *b, int n)
+{
+  b->n = n;
+  b->count = 0;
+  b->gen = 0;
+}
+
+// Wait until n threads have called barrier_wait.
+void
+barrier_wait(struct barrier *b)
+{
+  uint gen;
+
+  gen = b->gen;
+  if(__sync_fetch_and_add(&b->count, 1) == b->n - 1){
+    b->count = 0;
+    __sync_fetch_and_add(&b->gen, 1);
+    futex_wake(&b->gen, NPROC);
+    return;
+  }
+  while(*(volatile uint*)&b->gen == gen)
+    futex_wait(&b->gen, gen);
+}
+
+// Set by printf once it buffers output, so that exit
+// writes out what is left.
+void (*exitflush)(void);
+
+int
+exit(void)
+{
+  if(exitflush)
+    exitflush();
+  _exit();
+}
+
+// Set by printf too, so that close writes out what printf has
+// buffered for fd before the number can be reused.
+void (*closeflush)(int);
+
+int
+close(int fd)
+{
+  if(closeflush)
+    closeflush(fd);
+  return _close(fd);
+}
+
+// Threads.  Each gets a stack from malloc, which thread_join
+// frees, with fn and arg at the bottom of it for threadstart.
+#define THREADSTACK 8192
+
+struct threadarg {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+threadstart(void *a)
+{
+  struct threadarg *t = a;
+
+  t->fn(t->arg);
+  exit();
+}
+
+// Start a thread running fn(arg), sharing this process's
+// memory and open files.  Returns its pid, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct threadarg *t;
+  int pid;
+
+  if((t = malloc(THREADSTACK)) == 0)
+    return -1;
+  t->fn = fn;
+  t->arg = arg;
+  if((pid = clone(threadstart, t, t, THREADSTACK)) < 0)
+    free(t);
+  return pid;
+}
+
+// Wait for a thread to return from its function.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(stack);
+  return pid;
+}
+
+#define MAXJOBS 8
+
+// Workers for programs that handle each file on their own, like
+// cat -j.  Run fn(files[i]) for each file in a child whose
+// standard output is a pipe, with up to njob children running
+// at once, and copy their output out in file order.
+// Returns -1 if a child cannot be started.
+int
+forkeach(char **files, int nfile, int njob, int (*fn)(char*))
+{
+  int fds[MAXJOBS], p[2], i, next, pid, n;
+  char buf[512];
+
+  if(njob > MAXJOBS)
+    njob = MAXJOBS;
+  if(njob < 1)
+    njob = 1;
+  // Otherwise each child would print what is buffered again.
+  if(exitflush)
+    exitflush();
+  next = 0;
+  for(i = 0; i < nfile; i++){
+    for(; next < nfile && next < i + njob; next++){
+      if(pipe(p) < 0)
+        return -1;
+      if((pid = fork()) < 0){
+        close(p[0]);
+        close(p[1]);
+        return -1;
+      }
+      if(pid == 0){
+        close(p[0]);
+        close(1);
+        dup(p[1]);
+        close(p[1]);
+        fn(files[next]);
+        exit();
+      }
+      close(p[1]);
+      fds[next % njob] = p[0];
+    }
+    while((n = splice(fds[i % njob], 1, 64*1024)) > 0)
+      ;
+    if(n < 0)
+      while((n = read(fds[i % njob], buf, sizeof(buf))) > 0)
+        write(1, buf, n);
+    close(fds[i % njob]);
+    wait();
+  }
+  return 0;
+}
@@ -3,8 +3,14 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.  Blocks of up to NSMALL units, header
+// included, come from a free list per size, so malloc and free
+// of them take constant time.  An empty list is refilled by
+// cutting about RUNUNITS units into blocks of its size; small
+// blocks are never merged or given back to the large pool.
+// Larger blocks come from the allocator by Kernighan and Ritchie,
+// The C programming Language, 2nd ed.  Section 8.7, whose
+// address-ordered free list merges neighbours as they are freed.
 
 typedef long Align;
 
@@ -18,11 +24,16 @@ union header {
 
 typedef union header Header;
 
+#define NSMALL   64   // Largest small block, in units.
+#define RUNUNITS 512  // Units cut up at once to refill a small list.
+
 static Header base;
 static Header *freep;
+static Header *small[NSMALL+1];  // Free small blocks, by size.
+static struct mutex lock;  // for threads
 
-void
-free(void *ap)
+static void
+freeblock(void *ap)
 {
   Header *bp, *p;
 
@@ -43,6 +54,23 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  Header *bp;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  mutex_lock(&lock);
+  if(bp->s.size <= NSMALL){
+    bp->s.ptr = small[bp->s.size];
+    small[bp->s.size] = bp;
+  } else
+    freeblock(ap);
+  mutex_unlock(&lock);
+}
+
 static Header*
 morecore(uint nu)
 {
@@ -56,17 +84,17 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  freeblock((void*)(hp + 1));
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Take a block of nunits from the large free list, growing
+// the heap if none is big enough.  Caller must hold lock.
+static Header*
+bigalloc(uint nunits)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +109,49 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
-      return (void*)(p + 1);
+      return p;
     }
     if(p == freep)
       if((p = morecore(nunits)) == 0)
         return 0;
   }
 }
+
+// Refill the empty list of nunits-sized blocks.
+// Caller must hold lock.
+static void
+refill(uint nunits)
+{
+  Header *p;
+  uint i, n;
+
+  n = RUNUNITS / nunits;
+  if((p = bigalloc(n * nunits)) == 0)
+    return;
+  for(i = 0; i < n; i++, p += nunits){
+    p->s.size = nunits;
+    p->s.ptr = small[nunits];
+    small[nunits] = p;
+  }
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint nunits;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  mutex_lock(&lock);
+  if(nunits <= NSMALL){
+    if(small[nunits] == 0)
+      refill(nunits);
+    if((p = small[nunits]) != 0)
+      small[nunits] = p->s.ptr;
+  } else
+    p = bigalloc(nunits);
+  mutex_unlock(&lock);
+  if(p == 0)
+    return 0;
+  return (void*)(p + 1);
+}
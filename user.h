@@ -1,14 +1,39 @@
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct timespec;
+struct pollfd;
+struct ring;
+struct iovec;
+struct dirent;
+
+// Synchronization for threads (see ulib.c).
+struct lock {
+  uint locked;
+};
+
+struct mutex {
+  uint state;      // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+struct cond {
+  uint seq;        // Bumped by each signal
+};
+
+struct barrier {
+  uint n;          // Threads that must arrive
+  uint count;      // Threads arrived so far
+  uint gen;        // Bumped each time all n arrive
+};
 
 // system calls
 int fork(void);
-int exit(void) __attribute__((noreturn));
+int _exit(void) __attribute__((noreturn));
 int wait(void);
 int pipe(int*);
 int write(int, const void*, int);
 int read(int, void*, int);
-int close(int);
+int _close(int);
 int kill(int);
 int exec(char*, char**);
 int open(const char*, int);
@@ -23,17 +48,64 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int nanosleep(struct timespec*);
+int clock_gettime(int, struct timespec*);
+int date(struct rtcdate*);
+int lockprof(int);
+int lockstat(struct lockstat*, int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int clone(void(*)(void*), void*, void*, int);
+int join(void**);
+int futex_wait(void*, int);
+int futex_wake(void*, int);
+int fcntl(int, int, int);
+int splice(int, int, int);
+int poll(struct pollfd*, int, int);
+int pipe2(int*, int);
+int ringsetup(struct ring*);
+int ringenter(int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int getdents(int, struct dirent*, int);
+int fstatat(int, const char*, struct stat*);
 
 // ulib.c
+extern void (*exitflush)(void);
+extern void (*closeflush)(int);
+int exit(void) __attribute__((noreturn));
+int close(int);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
+void *memcpy(void*, const void*, uint);
+int memcmp(const void*, const void*, uint);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
-void printf(int, const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int clocknow(int, struct timespec*);
+void lock_acquire(struct lock*);
+void lock_release(struct lock*);
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void barrier_init(struct barrier*, int);
+void barrier_wait(struct barrier*);
+int forkeach(char**, int, int, int(*)(char*));
+
+// printf.c
+void printf(int, const char*, ...);
+void fflush(int);
+int sprintf(char*, const char*, ...);
+int snprintf(char*, int, const char*, ...);
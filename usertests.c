@@ -4,9 +4,16 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "mman.h"
 #include "syscall.h"
 #include "traps.h"
+#include "mmu.h"
 #include "memlayout.h"
+#include "date.h"
+#include "lockstat.h"
+#include "poll.h"
+#include "ring.h"
+#include "uio.h"
 
 char buf[8192];
 char name[3];
@@ -354,6 +361,737 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// A pipe's buffer can be resized, keeping the data in it.
+void
+pipesize(void)
+{
+  int fds[2], i, n, cc;
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 4096){
+    printf(1, "pipesize: wrong default size\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  if(write(fds[1], buf, 3000) != 3000){
+    printf(1, "pipesize: write failed\n");
+    exit();
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 20000) != 32768){
+    printf(1, "pipesize: F_SETPIPE_SZ failed\n");
+    exit();
+  }
+  // Would block forever with the old size.
+  for(n = 3000; n < 3000 + 6*4096; n += 4096){
+    if(write(fds[1], buf + (n & 0xff), 4096) != 4096){
+      printf(1, "pipesize: write failed\n");
+      exit();
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1){
+    printf(1, "pipesize: shrank below the data in the pipe\n");
+    exit();
+  }
+  for(n = 0; n < 3000 + 6*4096; n += cc){
+    if((cc = read(fds[0], buf, sizeof(buf))) <= 0){
+      printf(1, "pipesize: read failed\n");
+      exit();
+    }
+    for(i = 0; i < cc; i++){
+      if((buf[i] & 0xff) != ((n + i) & 0xff)){
+        printf(1, "pipesize: wrong data\n");
+        exit();
+      }
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "pipesize ok\n");
+}
+
+// splice moves data from a file to a pipe, between pipes,
+// and from a pipe to a file.
+void
+splicetest(void)
+{
+  int fd, p1[2], p2[2], i, n, cc;
+
+  printf(1, "splice test\n");
+  fd = open("splicein", O_CREATE|O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf) ||
+     write(fd, buf, 1808) != 1808){
+    printf(1, "splice: create splicein failed\n");
+    exit();
+  }
+  close(fd);
+  if(pipe(p1) != 0 || pipe(p2) != 0 ||
+     fcntl(p1[0], F_SETPIPE_SZ, 16384) < 0 ||
+     fcntl(p2[0], F_SETPIPE_SZ, 16384) < 0){
+    printf(1, "splice: pipe failed\n");
+    exit();
+  }
+
+  fd = open("splicein", O_RDONLY);
+  if((n = splice(fd, p1[1], 20000)) != 10000 || splice(fd, p1[1], 10) != 0){
+    printf(1, "splice: file to pipe moved %d\n", n);
+    exit();
+  }
+  close(fd);
+  if((n = splice(p1[0], p2[1], 20000)) != 10000){
+    printf(1, "splice: pipe to pipe moved %d\n", n);
+    exit();
+  }
+  fd = open("spliceout", O_CREATE|O_RDWR);
+  if((n = splice(p2[0], fd, 20000)) != 10000){
+    printf(1, "splice: pipe to file moved %d\n", n);
+    exit();
+  }
+  close(fd);
+
+  fd = open("spliceout", O_RDONLY);
+  for(n = 0; (cc = read(fd, buf, sizeof(buf))) > 0; n += cc){
+    for(i = 0; i < cc; i++){
+      if((buf[i] & 0xff) != ((n + i) & 0xff)){
+        printf(1, "splice: wrong data\n");
+        exit();
+      }
+    }
+  }
+  if(n != 10000){
+    printf(1, "splice: spliceout has %d bytes\n", n);
+    exit();
+  }
+  close(fd);
+  for(i = 0; i < 2; i++){
+    close(p1[i]);
+    close(p2[i]);
+  }
+  unlink("splicein");
+  unlink("spliceout");
+  printf(1, "splice test ok\n");
+}
+
+// poll waits for the first of several pipes to become ready,
+// times out, and reports hangups and bad descriptors.
+void
+polltest(void)
+{
+  struct pollfd pfd[3];
+  int a[2], b[2], pid, t0;
+
+  printf(1, "poll test\n");
+  if(pipe(a) != 0 || pipe(b) != 0){
+    printf(1, "poll: pipe failed\n");
+    exit();
+  }
+  pfd[0].fd = a[0];
+  pfd[1].fd = b[0];
+  pfd[2].fd = b[1];
+  pfd[0].events = pfd[1].events = POLLIN;
+  pfd[2].events = POLLOUT;
+  if(poll(pfd, 3, 0) != 1 || pfd[0].revents || pfd[1].revents ||
+     pfd[2].revents != POLLOUT){
+    printf(1, "poll: wrong readiness for empty pipes\n");
+    exit();
+  }
+
+  t0 = uptime();
+  if(poll(pfd, 2, 50) != 0 || uptime() - t0 < 4){
+    printf(1, "poll: timeout did not wait\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "poll: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    sleep(5);
+    write(b[1], "x", 1);
+    exit();
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents || pfd[1].revents != POLLIN){
+    printf(1, "poll: missed pipe write\n");
+    exit();
+  }
+  wait();
+
+  close(a[1]);
+  pfd[2].fd = 100;
+  if(poll(pfd, 3, -1) != 3 || pfd[0].revents != POLLHUP ||
+     pfd[1].revents != POLLIN || pfd[2].revents != POLLNVAL){
+    printf(1, "poll: wrong hangup or bad fd\n");
+    exit();
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+  printf(1, "poll test ok\n");
+}
+
+// O_NONBLOCK pipes return EAGAIN instead of waiting.
+void
+nonblocktest(void)
+{
+  int p[2], fd;
+
+  printf(1, "nonblock test\n");
+  if(pipe2(p, O_NONBLOCK) != 0){
+    printf(1, "nonblock: pipe2 failed\n");
+    exit();
+  }
+  if(fcntl(p[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK) ||
+     fcntl(p[1], F_GETFL, 0) != (O_WRONLY|O_NONBLOCK)){
+    printf(1, "nonblock: wrong flags\n");
+    exit();
+  }
+  if(read(p[0], buf, 1) != EAGAIN){
+    printf(1, "nonblock: read of empty pipe did not fail\n");
+    exit();
+  }
+  if(write(p[1], buf, sizeof(buf)) != 4096 || write(p[1], buf, 1) != EAGAIN){
+    printf(1, "nonblock: write to full pipe did not stop\n");
+    exit();
+  }
+  if(read(p[0], buf, sizeof(buf)) != 4096){
+    printf(1, "nonblock: read failed\n");
+    exit();
+  }
+  if(fcntl(p[0], F_SETFL, 0) != 0 || fcntl(p[0], F_GETFL, 0) != O_RDONLY){
+    printf(1, "nonblock: F_SETFL failed\n");
+    exit();
+  }
+  close(p[1]);
+  if(read(p[0], buf, 1) != 0){
+    printf(1, "nonblock: no end of file\n");
+    exit();
+  }
+  close(p[0]);
+
+  fd = open("README", O_RDONLY|O_NONBLOCK);
+  if(fd < 0 || read(fd, buf, 10) != 10){
+    printf(1, "nonblock: cannot read README\n");
+    exit();
+  }
+  close(fd);
+  printf(1, "nonblock test ok\n");
+}
+
+struct ring ring;
+
+// Queue one request on ring.
+void
+ringsubmit(int op, int fd, void *addr, int len, uint data)
+{
+  struct sqe *e;
+
+  e = &ring.sq[ring.sqtail % RINGSIZE];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint)addr;
+  e->len = len;
+  e->data = data;
+  ring.sqtail++;
+}
+
+// Take the next completion from ring, checking that it is
+// for request data, and return its result.
+int
+ringreap(uint data)
+{
+  struct cqe *c;
+
+  if(ring.cqhead == ring.cqtail){
+    printf(1, "ring: missing completion %d\n", data);
+    exit();
+  }
+  c = &ring.cq[ring.cqhead++ % RINGSIZE];
+  if(c->data != data){
+    printf(1, "ring: completion %d for request %d\n", c->data, data);
+    exit();
+  }
+  return c->res;
+}
+
+// Write a file and read it back with batches of requests on
+// a submission ring.
+void
+ringtest(void)
+{
+  int fd, i;
+
+  printf(1, "ring test\n");
+  if(ringenter(1) != -1 || ringsetup(&ring) != 0){
+    printf(1, "ring: setup failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++)
+    buf[i] = i;
+  ringsubmit(RING_OPEN, 0, "ringfile", O_CREATE|O_RDWR, 0);
+  if(ringenter(10) != 1 || (fd = ringreap(0)) < 0){
+    printf(1, "ring: open failed\n");
+    exit();
+  }
+  for(i = 0; i < 8; i++)
+    ringsubmit(RING_WRITE, fd, buf + i*512, 512, i);
+  ringsubmit(RING_FSYNC, fd, 0, 0, 8);
+  ringsubmit(RING_CLOSE, fd, 0, 0, 9);
+  if(ringenter(100) != 10){
+    printf(1, "ring: write batch did not run\n");
+    exit();
+  }
+  for(i = 0; i < 8; i++){
+    if(ringreap(i) != 512){
+      printf(1, "ring: write failed\n");
+      exit();
+    }
+  }
+  if(ringreap(8) != 0 || ringreap(9) != 0){
+    printf(1, "ring: fsync or close failed\n");
+    exit();
+  }
+
+  ringsubmit(RING_OPEN, 0, "ringfile", O_RDONLY, 0);
+  if(ringenter(1) != 1 || (fd = ringreap(0)) < 0){
+    printf(1, "ring: reopen failed\n");
+    exit();
+  }
+  for(i = 0; i < 8; i++)
+    ringsubmit(RING_READ, fd, buf + 4096 + i*512, 512, i);
+  ringsubmit(RING_CLOSE, fd, 0, 0, 8);
+  ringsubmit(RING_CLOSE, fd, 0, 0, 9);
+  ringsubmit(99, 0, 0, 0, 10);
+  if(ringenter(100) != 11){
+    printf(1, "ring: read batch did not run\n");
+    exit();
+  }
+  for(i = 0; i < 8; i++){
+    if(ringreap(i) != 512){
+      printf(1, "ring: read failed\n");
+      exit();
+    }
+  }
+  if(ringreap(8) != 0 || ringreap(9) != -1 || ringreap(10) != -1){
+    printf(1, "ring: bad requests did not fail\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++){
+    if(buf[4096 + i] != buf[i]){
+      printf(1, "ring: read back wrong data\n");
+      exit();
+    }
+  }
+  ringsetup(0);
+  unlink("ringfile");
+  printf(1, "ring test ok\n");
+}
+
+// writev gathers buffers into one write, readv scatters one
+// read, and pread and pwrite leave the file offset alone.
+void
+uiotest(void)
+{
+  struct iovec iov[3];
+  struct stat st;
+  int fd, i, p[2];
+
+  printf(1, "uio test\n");
+  for(i = 0; i < 600; i++)
+    buf[i] = 'a' + i % 26;
+  iov[0].base = "hdr:";
+  iov[0].len = 4;
+  iov[1].base = buf;
+  iov[1].len = 600;
+  iov[2].base = "end";
+  iov[2].len = 3;
+  fd = open("uiofile", O_CREATE|O_RDWR);
+  if(fd < 0 || writev(fd, iov, 3) != 607 || fstat(fd, &st) < 0 ||
+     st.size != 607){
+    printf(1, "uio: writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "HDR:", 4, 0) != 4 || read(fd, buf + 1000, 10) != 0 ||
+     pread(fd, buf + 1000, 600, 4) != 600){
+    printf(1, "uio: pwrite or pread failed\n");
+    exit();
+  }
+  for(i = 0; i < 600; i++){
+    if(buf[1000 + i] != buf[i]){
+      printf(1, "uio: pread read wrong data\n");
+      exit();
+    }
+  }
+  close(fd);
+
+  fd = open("uiofile", O_RDONLY);
+  iov[0].base = buf + 2000;
+  iov[0].len = 4;
+  iov[1].base = buf + 3000;
+  iov[1].len = 1000;
+  if(readv(fd, iov, 2) != 607 || memcmp(buf + 2000, "HDR:", 4) != 0 ||
+     memcmp(buf + 3000, buf, 600) != 0 || memcmp(buf + 3600, "end", 3) != 0){
+    printf(1, "uio: readv failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("uiofile");
+
+  if(pipe(p) != 0 || pread(p[0], buf, 1, 0) != -1){
+    printf(1, "uio: pread on a pipe did not fail\n");
+    exit();
+  }
+  close(p[0]);
+  close(p[1]);
+  printf(1, "uio test ok\n");
+}
+
+// getdents returns all of a directory's entries, a few at a
+// time, and fstatat finds them relative to the directory.
+void
+getdentstest(void)
+{
+  struct dirent de[5];
+  struct stat st;
+  char name[4];
+  int fd, dfd, i, n, count;
+
+  printf(1, "getdents test\n");
+  if(mkdir("gdir") != 0){
+    printf(1, "getdents: mkdir failed\n");
+    exit();
+  }
+  name[0] = 'f';
+  name[3] = 0;
+  for(i = 0; i < 20; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    if(chdir("gdir") != 0 || (fd = open(name, O_CREATE|O_RDWR)) < 0 ||
+       write(fd, buf, i) != i || chdir("..") != 0){
+      printf(1, "getdents: create failed\n");
+      exit();
+    }
+    close(fd);
+  }
+  unlink("gdir/f13");
+
+  dfd = open("gdir", O_RDONLY);
+  count = 0;
+  while((n = getdents(dfd, de, sizeof(de))) > 0){
+    for(i = 0; i < n / sizeof(de[0]); i++){
+      if(de[i].inum == 0){
+        printf(1, "getdents: empty entry\n");
+        exit();
+      }
+      count++;
+    }
+  }
+  if(n != 0 || count != 2 + 19){
+    printf(1, "getdents: found %d entries\n", count);
+    exit();
+  }
+  if(fstatat(dfd, "f07", &st) != 0 || st.type != T_FILE || st.size != 7 ||
+     fstatat(dfd, "f13", &st) != -1 || fstatat(dfd, "..", &st) != 0 ||
+     st.type != T_DIR){
+    printf(1, "getdents: fstatat failed\n");
+    exit();
+  }
+  close(dfd);
+
+  for(i = 0; i < 20; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    chdir("gdir");
+    unlink(name);
+    chdir("..");
+  }
+  if(unlink("gdir") != 0){
+    printf(1, "getdents: unlink gdir failed\n");
+    exit();
+  }
+  printf(1, "getdents test ok\n");
+}
+
+// O_DIRECT reads, aligned ones straight into user pages and
+// unaligned ones through the buffer cache, must see the same bytes.
+void
+directtest(void)
+{
+  char *p, *a, *m;
+  int fd, mfd, i;
+
+  printf(1, "direct test\n");
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i * 7 + i / 512;
+  fd = open("direct", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(1, "direct: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  p = sbrk(sizeof(buf) + 512);
+  a = (char*)(((uint)p + 511) & ~511);
+  fd = open("direct", O_RDONLY|O_DIRECT);
+  if(fd < 0 || (fcntl(fd, F_GETFL, 0) & O_DIRECT) == 0){
+    printf(1, "direct: open failed\n");
+    exit();
+  }
+  if(read(fd, a, sizeof(buf)) != sizeof(buf) ||
+     memcmp(a, buf, sizeof(buf)) != 0){
+    printf(1, "direct: aligned read wrong\n");
+    exit();
+  }
+  if(read(fd, a, 512) != 0){
+    printf(1, "direct: read past end\n");
+    exit();
+  }
+  if(pread(fd, a + 1, 3000, 100) != 3000 ||
+     memcmp(a + 1, buf + 100, 3000) != 0){
+    printf(1, "direct: unaligned read wrong\n");
+    exit();
+  }
+
+  // Stores to a shared mapping are newer than the disk, and a
+  // read into one must reach the file when it is unmapped.
+  mfd = open("direct", O_RDWR);
+  m = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, mfd, 0);
+  if(mfd < 0 || m == MAP_FAILED){
+    printf(1, "direct: mmap failed\n");
+    exit();
+  }
+  memset(m, 'm', 512);
+  if(pread(fd, a, 512, 0) != 512 || a[0] != 'm' || a[511] != 'm'){
+    printf(1, "direct: read missed a dirty mapping\n");
+    exit();
+  }
+  if(pread(fd, m + 1024, 512, 4096) != 512){
+    printf(1, "direct: read into mapping failed\n");
+    exit();
+  }
+  munmap(m, 4096);
+  if(pread(mfd, a, 512, 1024) != 512 || memcmp(a, buf + 4096, 512) != 0){
+    printf(1, "direct: read into mapping lost\n");
+    exit();
+  }
+  close(mfd);
+  close(fd);
+  sbrk(-(sizeof(buf) + 512));
+  unlink("direct");
+  printf(1, "direct test ok\n");
+}
+
+void
+printftest(void)
+{
+  char s[32];
+  int fd, fd2, n;
+
+  printf(1, "printf test\n");
+  if(sprintf(s, "%d %x %s %c%%", -42, 255, "ok", 'z') != 12 ||
+     strcmp(s, "-42 FF ok z%") != 0){
+    printf(1, "printf: sprintf wrong: %s\n", s);
+    exit();
+  }
+  if(snprintf(s, 5, "abc%d", 12345) != 8 || strcmp(s, "abc1") != 0 ||
+     snprintf(0, 0, "%s", "xyz") != 3){
+    printf(1, "printf: snprintf wrong\n");
+    exit();
+  }
+
+  // Output to a file waits in the buffer until fflush.
+  fd = open("printf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "printf: open failed\n");
+    exit();
+  }
+  printf(fd, "line %d\n", 1);
+  printf(fd, "line %d\n", 2);
+  if(pread(fd, s, sizeof(s), 0) != 0){
+    printf(1, "printf: file output not buffered\n");
+    exit();
+  }
+  fflush(fd);
+  n = pread(fd, s, sizeof(s), 0);
+  if(n != 14 || memcmp(s, "line 1\nline 2\n", 14) != 0){
+    printf(1, "printf: fflush wrote %d bytes\n", n);
+    exit();
+  }
+
+  // close writes out the buffer, which must not follow the
+  // fd number to the next file opened.
+  printf(fd, "line %d\n", 3);
+  close(fd);
+  if((fd2 = open("printf2", O_CREATE|O_RDWR)) != fd){
+    printf(1, "printf: fd not reused\n");
+    exit();
+  }
+  fflush(fd2);
+  close(fd2);
+  fd = open("printf", O_RDONLY);
+  n = read(fd, s, sizeof(s));
+  close(fd);
+  fd2 = open("printf2", O_RDONLY);
+  if(n != 21 || read(fd2, s, sizeof(s)) != 0){
+    printf(1, "printf: close did not flush\n");
+    exit();
+  }
+  close(fd2);
+  unlink("printf2");
+  unlink("printf");
+  printf(1, "printf test ok\n");
+}
+
+// A system call made with the trap flag set must not upset the
+// kernel.  sysenter, unlike int, leaves FL_TF set in the kernel.
+// The first two children are killed by their next single-step
+// trap in user space, so the kernel prints a kill message for
+// each.  The last sleeps with FL_NT set, which the kernel must
+// not carry into another process.
+void
+steptest(void)
+{
+  int i, pid, r;
+  uint fl;
+
+  printf(1, "step test\n");
+  for(i = 0; i < 3; i++){
+    if(i > 0 && *(uint*)SYSENTEROK == 0)
+      break;
+    pid = fork();
+    if(pid < 0){
+      printf(1, "step: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if(i == 0){
+        // The step trap comes after the call, in the stub.
+        asm volatile("pushfl; orl %0, (%%esp); popfl" : : "i" (FL_TF) : "cc");
+        getpid();
+      } else if(i == 1){
+        // sysenter right after popfl, as the stub would do it,
+        // so that the step trap comes inside the kernel.
+        r = SYS_getpid;
+        asm volatile("pushfl; orl %0, (%%esp);"
+                     "movl $1f, %%edx; leal 4(%%esp), %%ecx;"
+                     "popfl; sysenter; 1:"
+                     : "+a" (r) : "i" (FL_TF)
+                     : "ecx", "edx", "memory", "cc");
+      } else {
+        asm volatile("pushfl; orl %0, (%%esp); popfl" : : "i" (FL_NT) : "cc");
+        sleep(1);
+        asm volatile("pushfl; popl %0" : "=r" (fl));
+        asm volatile("pushfl; andl %0, (%%esp); popfl" : : "i" (~FL_NT) : "cc");
+        if((fl & FL_NT) == 0)
+          printf(1, "step: FL_NT lost\n");
+      }
+      exit();
+    }
+    if(wait() != pid){
+      printf(1, "step: wait failed\n");
+      exit();
+    }
+  }
+  printf(1, "step test ok\n");
+}
+
+// memmove, memcpy, memcmp, strlen and strchr work a word at a
+// time; check them at every alignment against byte loops.
+void
+stringtest(void)
+{
+  static char a[64], b[64], c[64];
+  char *src, *dst, *p, *e;
+  int d, s, n, off, i, k;
+
+  printf(1, "string test\n");
+  for(d = 0; d < 4; d++)
+  for(s = 0; s < 4; s++)
+  for(n = 0; n <= 16; n++){
+    for(k = 0; k < 2; k++){
+      for(i = 0; i < 64; i++)
+        a[i] = i, b[i] = 100 + i;
+      if(k == 0)
+        memmove(a + d, b + s, n);
+      else
+        memcpy(a + d, b + s, n);
+      for(i = 0; i < 64; i++)
+        if(a[i] != (i >= d && i < d + n ? b[s + i - d] : i)){
+          printf(1, "string: %s %d %d %d wrong\n",
+            k ? "memcpy" : "memmove", d, s, n);
+          exit();
+        }
+    }
+
+    // Overlapping moves, up and down.
+    for(off = -6; off <= 6; off++){
+      for(i = 0; i < 64; i++)
+        a[i] = c[i] = i;
+      src = a + 24 + s;
+      dst = src + off + d;
+      for(i = 0; i < n; i++)
+        b[i] = src[i];
+      for(i = 0; i < n; i++)
+        c[dst - a + i] = b[i];
+      memmove(dst, src, n);
+      if(memcmp(a, c, sizeof(a)) != 0){
+        printf(1, "string: overlapping memmove %d %d %d wrong\n", off + d, s, n);
+        exit();
+      }
+    }
+
+    for(i = 0; i < n; i++)
+      a[d + i] = b[s + i] = 'a' + i;
+    if(memcmp(a + d, b + s, n) != 0){
+      printf(1, "string: memcmp %d %d %d wrong\n", d, s, n);
+      exit();
+    }
+    for(i = 0; i < n; i++){
+      b[s + i]++;
+      if(memcmp(a + d, b + s, n) >= 0 || memcmp(b + s, a + d, n) <= 0){
+        printf(1, "string: memcmp %d %d %d at %d wrong\n", d, s, n, i);
+        exit();
+      }
+      b[s + i]--;
+    }
+
+    a[d + n] = 0;
+    if(strlen(a + d) != n || strchr(a + d, 'z') != 0 ||
+       strchr(a + d, 0) != 0){
+      printf(1, "string: strlen/strchr %d %d wrong\n", d, n);
+      exit();
+    }
+    for(i = 0; i < n; i++)
+      if(strchr(a + d, 'a' + i) != a + d + i){
+        printf(1, "string: strchr %d %d %d wrong\n", d, n, i);
+        exit();
+      }
+  }
+
+  // Strings ending at the last byte before unmapped memory.
+  p = sbrk(0);
+  k = PGROUNDUP((uint)p) + PGSIZE - (uint)p;
+  sbrk(k);
+  e = p + k;
+  e[-1] = 0;
+  for(n = 0; n <= 16; n++){
+    for(i = 0; i < n; i++)
+      e[-2 - i] = 'a';
+    if(strlen(e - 1 - n) != n || strchr(e - 1 - n, 'z') != 0){
+      printf(1, "string: page end %d wrong\n", n);
+      exit();
+    }
+  }
+  sbrk(-k);
+  printf(1, "string test ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -424,6 +1162,464 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// do sleep() and nanosleep() wait as long as asked,
+// now that sleepers are woken by their own timer?
+void
+sleeptest(void)
+{
+  struct timespec ts;
+  int t0, t1;
+
+  printf(stdout, "sleep test\n");
+  t0 = uptime();
+  if(sleep(10) < 0){
+    printf(stdout, "sleep failed\n");
+    exit();
+  }
+  t1 = uptime();
+  if(t1 - t0 < 10){
+    printf(stdout, "sleep(10) returned after %d ticks\n", t1 - t0);
+    exit();
+  }
+
+  ts.sec = 0;
+  ts.nsec = 50*1000*1000;
+  t0 = uptime();
+  if(nanosleep(&ts) < 0){
+    printf(stdout, "nanosleep failed\n");
+    exit();
+  }
+  t1 = uptime();
+  if(t1 - t0 < 4){
+    printf(stdout, "nanosleep(50ms) returned after %d ticks\n", t1 - t0);
+    exit();
+  }
+  ts.nsec = 1000000000;
+  if(nanosleep(&ts) != -1){
+    printf(stdout, "nanosleep accepted nsec out of range\n");
+    exit();
+  }
+  printf(stdout, "sleep test ok\n");
+}
+
+// do the clock system call and the user-readable
+// clock page agree, and does time go forward?
+void
+clocktest(void)
+{
+  struct timespec t[3];
+  int i;
+
+  printf(stdout, "clock test\n");
+  if(clocknow(CLOCK_MONOTONIC, &t[0]) < 0 ||
+     clock_gettime(CLOCK_MONOTONIC, &t[1]) < 0 ||
+     clocknow(CLOCK_MONOTONIC, &t[2]) < 0){
+    printf(stdout, "clock read failed\n");
+    exit();
+  }
+  for(i = 1; i < 3; i++){
+    if(t[i].nsec >= 1000000000 || t[i].sec < t[i-1].sec ||
+       (t[i].sec == t[i-1].sec && t[i].nsec < t[i-1].nsec)){
+      printf(stdout, "clock went backwards\n");
+      exit();
+    }
+  }
+  if(clock_gettime(CLOCK_REALTIME, &t[0]) < 0 || t[0].sec < 1500000000){
+    printf(stdout, "bad realtime clock\n");
+    exit();
+  }
+  printf(stdout, "clock test ok\n");
+}
+
+// lockstat should count the ptable.lock acquisitions
+// made by fork and wait after profiling starts.
+void
+lockstattest(void)
+{
+  struct lockstat st[32];
+  int i, n, pid;
+
+  printf(stdout, "lockstat test\n");
+  lockprof(1);
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0)
+    exit();
+  wait();
+  if(lockprof(0) != 1){
+    printf(stdout, "lockprof was not on\n");
+    exit();
+  }
+  n = lockstat(st, 32);
+  for(i = 0; i < n; i++)
+    if(st[i].pc == 0 && strcmp(st[i].name, "ptable") == 0)
+      break;
+  if(i == n || st[i].nacquire == 0){
+    printf(stdout, "no ptable lock statistics\n");
+    exit();
+  }
+  printf(stdout, "lockstat test ok\n");
+}
+
+// Program text is mapped read-only, from pages shared
+// with other processes: neither the process nor the kernel
+// on its behalf may write it.
+void
+textwritetest(void)
+{
+  int fd, pid, ppid;
+
+  printf(stdout, "text write test\n");
+  fd = open("README", 0);
+  if(fd < 0){
+    printf(stdout, "open README failed\n");
+    exit();
+  }
+  if(read(fd, (char*)textwritetest, 1) != -1){
+    printf(stdout, "read into text succeeded\n");
+    exit();
+  }
+  close(fd);
+
+  ppid = getpid();
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    *(volatile char*)textwritetest = 0;
+    printf(stdout, "write to text succeeded\n");
+    kill(ppid);
+    exit();
+  }
+  wait();
+  printf(stdout, "text write test ok\n");
+}
+
+// Stores into a shared mapping of a file are seen by read(),
+// by a forked child, and are in the file after munmap; stores
+// into a private mapping are not.
+void
+mmaptest(void)
+{
+  int fd, i, pid;
+  char *p;
+
+  printf(stdout, "mmap test\n");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "create mmapfile failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "write mmapfile failed\n");
+    exit();
+  }
+
+  p = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf(stdout, "mmap shared failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++){
+    if(p[i] != (char)i){
+      printf(stdout, "mmap contents wrong\n");
+      exit();
+    }
+  }
+  p[0] = 'x';
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    p[5000] = 'y';
+    exit();
+  }
+  wait();
+  if(p[5000] != 'y'){
+    printf(stdout, "child's store not shared\n");
+    exit();
+  }
+  close(fd);
+  fd = open("mmapfile", O_RDWR);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'x' || buf[5000] != 'y'){
+    printf(stdout, "read does not see mapped stores\n");
+    exit();
+  }
+  if(munmap(p, sizeof(buf)) < 0){
+    printf(stdout, "munmap failed\n");
+    exit();
+  }
+
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED || p[0] != 'x'){
+    printf(stdout, "mmap private failed\n");
+    exit();
+  }
+  p[0] = 'z';
+  munmap(p, 4096);
+  close(fd);
+  fd = open("mmapfile", 0);
+  if(read(fd, buf, 1) != 1 || buf[0] != 'x'){
+    printf(stdout, "private store reached the file\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+  printf(stdout, "mmap test ok\n");
+}
+
+// Anonymous shared memory is shared with children, even pages
+// that neither process touched before the fork; anonymous
+// private memory is zeroed and copied.
+void
+shmtest(void)
+{
+  int i, pid;
+  volatile char *p, *q;
+
+  printf(stdout, "shm test\n");
+  p = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  q = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED || q == MAP_FAILED){
+    printf(stdout, "mmap anonymous failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(p[i] != 0){
+      printf(stdout, "anonymous memory not zeroed\n");
+      exit();
+    }
+  }
+  q[0] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    p[2*4096 + 1] = 'c';
+    q[0] = 'c';
+    // Wait for the parent's reply through the shared page.
+    while(p[0] != 'p')
+      ;
+    p[1] = 'd';
+    exit();
+  }
+  while(p[2*4096 + 1] != 'c')
+    ;
+  p[0] = 'p';
+  wait();
+  if(p[1] != 'd' || q[0] != 'p'){
+    printf(stdout, "anonymous sharing wrong\n");
+    exit();
+  }
+  if(munmap((char*)p, 3*4096) < 0 || munmap((char*)q, 4096) < 0){
+    printf(stdout, "munmap anonymous failed\n");
+    exit();
+  }
+  printf(stdout, "shm test ok\n");
+}
+
+static struct lock threadlock;
+static volatile int threadcount;
+static volatile int threadfd = -1;
+
+static void
+threadinc(void *arg)
+{
+  int i;
+  char *p;
+
+  for(i = 0; i < 1000; i++){
+    lock_acquire(&threadlock);
+    threadcount += (int)arg;
+    lock_release(&threadlock);
+    if(i % 100 == 0){
+      if((p = malloc(3000)) == 0){
+        printf(stdout, "malloc in thread failed\n");
+        exit();
+      }
+      p[0] = 1;
+      free(p);
+    }
+  }
+}
+
+static void
+threadopen(void *arg)
+{
+  threadfd = open(arg, O_CREATE|O_RDWR);
+}
+
+static void
+threadsleep(void *arg)
+{
+  for(;;)
+    sleep(100);
+}
+
+// Threads share memory and open files, and join
+// reaps them.  exec kills the other threads.
+void
+threadtest(void)
+{
+  char *echoargv[] = { "echo", 0 };
+  int i, pid, p[2];
+  char c;
+
+  printf(stdout, "thread test\n");
+  for(i = 0; i < 4; i++){
+    if(thread_create(threadinc, (void*)1) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join() < 0){
+      printf(stdout, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(thread_join() != -1){
+    printf(stdout, "thread_join with no threads succeeded\n");
+    exit();
+  }
+  if(threadcount != 4000){
+    printf(stdout, "threads lost updates: %d\n", threadcount);
+    exit();
+  }
+
+  if(thread_create(threadopen, "threadfile") < 0 || thread_join() < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  if(threadfd < 0 || write(threadfd, "x", 1) != 1){
+    printf(stdout, "thread's open file not shared\n");
+    exit();
+  }
+  close(threadfd);
+  unlink("threadfile");
+
+  // The pipe's write end stays open while a thread of the
+  // child lives on after its exec.
+  if(pipe2(p, O_NONBLOCK) < 0){
+    printf(stdout, "pipe2 failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(p[0]);
+    if(thread_create(threadsleep, 0) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+    exec("echo", echoargv);
+    printf(stdout, "exec echo failed\n");
+    exit();
+  }
+  close(p[1]);
+  wait();
+  if(read(p[0], &c, 1) != 0){
+    printf(stdout, "thread outlived exec\n");
+    exit();
+  }
+  close(p[0]);
+  printf(stdout, "thread test ok\n");
+}
+
+static struct mutex futexmu;
+static struct cond futexcv;
+static struct barrier futexbar;
+static volatile int futexcount, futexitems;
+static volatile int futexphase[4];
+
+static void
+futexworker(void *arg)
+{
+  int i, id, round;
+
+  id = (int)arg;
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&futexmu);
+    futexcount++;
+    mutex_unlock(&futexmu);
+  }
+
+  // Take the items the main thread hands out.
+  for(i = 0; i < 10; i++){
+    mutex_lock(&futexmu);
+    while(futexitems == 0)
+      cond_wait(&futexcv, &futexmu);
+    futexitems--;
+    mutex_unlock(&futexmu);
+  }
+
+  // No thread starts a round before all finished the last.
+  for(round = 1; round <= 10; round++){
+    futexphase[id] = round;
+    barrier_wait(&futexbar);
+    for(i = 0; i < 4; i++){
+      if(futexphase[i] < round){
+        printf(stdout, "barrier let thread through early\n");
+        exit();
+      }
+    }
+    barrier_wait(&futexbar);
+  }
+}
+
+// Mutex, condition variable and barrier built on futexes.
+void
+futextest(void)
+{
+  int i;
+  uint word;
+
+  printf(stdout, "futex test\n");
+  word = 1;
+  if(futex_wait(&word, 0) != -1){
+    printf(stdout, "futex_wait on a changed word slept\n");
+    exit();
+  }
+  barrier_init(&futexbar, 4);
+  for(i = 0; i < 4; i++){
+    if(thread_create(futexworker, (void*)i) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 40; i++){
+    mutex_lock(&futexmu);
+    futexitems++;
+    cond_signal(&futexcv);
+    mutex_unlock(&futexmu);
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join() < 0){
+      printf(stdout, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(futexcount != 4000 || futexitems != 0){
+    printf(stdout, "futex test wrong: %d %d\n", futexcount, futexitems);
+    exit();
+  }
+  printf(stdout, "futex test ok\n");
+}
+
 void
 mem(void)
 {
@@ -1781,8 +2977,27 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipesize();
+  splicetest();
+  polltest();
+  nonblocktest();
+  ringtest();
+  uiotest();
+  getdentstest();
+  directtest();
+  printftest();
+  steptest();
+  stringtest();
   preempt();
   exitwait();
+  sleeptest();
+  clocktest();
+  lockstattest();
+  textwritetest();
+  mmaptest();
+  shmtest();
+  threadtest();
+  futextest();
 
   rmdot();
   fourteen();
@@ -6,10 +6,23 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "page.h"
+#include "mm.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
+extern char clockpage[];  // in timer.c
 pde_t *kpgdir;  // for use in scheduler()
 
+struct {
+  struct spinlock lock;
+  struct mm mm[NPROC];
+} mmtable;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -87,8 +100,9 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //
 // setupkvm() and exec() set up every page table like this:
 //
-//   0..KERNBASE: user memory (text+data+stack+heap), mapped to
+//   0..USERTOP: user memory (text+data+stack+heap), mapped to
 //                phys memory allocated by the kernel
+//   CLOCKPAGE..KERNBASE: kernel's clock data, read-only for the user
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
@@ -112,6 +126,7 @@ static struct kmap {
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
  { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
+ { (void*)CLOCKPAGE, V2P(clockpage), V2P(clockpage)+PGSIZE, PTE_U}, // clock
 };
 
 // Set up kernel part of a page table.
@@ -160,8 +175,6 @@ switchuvm(struct proc *p)
     panic("switchuvm: no process");
   if(p->kstack == 0)
     panic("switchuvm: no kstack");
-  if(p->pgdir == 0)
-    panic("switchuvm: no pgdir");
 
   pushcli();
   mycpu()->gdt[SEG_TSS] = SEG16(STS_T32A, &mycpu()->ts,
@@ -169,14 +182,47 @@ switchuvm(struct proc *p)
   mycpu()->gdt[SEG_TSS].s = 0;
   mycpu()->ts.ss0 = SEG_KDATA << 3;
   mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  if(sysenterok)
+    wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
   // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  if(p->mm)
+    lcr3(V2P(p->mm->pgdir));  // switch to process's address space
+  else
+    lcr3(V2P(kpgdir));  // exiting: only the kernel is left
   popcli();
 }
 
+// Flush the TLB of every CPU running a thread that uses mm,
+// after some of mm's mappings were removed, and wait until
+// they have done so.  Interrupts must be enabled, since another
+// CPU doing the same may be waiting for this one.
+void
+tlbflush(struct mm *mm)
+{
+  struct cpu *c, *me;
+
+  if(!(readeflags()&FL_IF))
+    panic("tlbflush");
+
+  __sync_synchronize();  // page table stores before reading c->proc
+  pushcli();
+  me = mycpu();
+  lcr3(rcr3());
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c != me && c->proc && c->proc->mm == mm){
+      c->tlbflush = 1;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+    }
+  }
+  popcli();
+  for(c = cpus; c < cpus+ncpu; c++)
+    while(c->tlbflush)
+      pause();
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -192,30 +238,6 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -224,7 +246,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > USERTOP)
     return 0;
   if(newsz < oldsz)
     return oldsz;
@@ -287,7 +309,7 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
+  deallocuvm(pgdir, USERTOP, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -311,9 +333,12 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  Pages marked PTE_S are shared with
+// the child; the rest are copied.  Pages of vmas that the
+// parent has not touched yet are left for the child to
+// fault in.
 pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+copyuvm(pde_t *pgdir)
 {
   pde_t *d;
   pte_t *pte;
@@ -322,16 +347,23 @@ copyuvm(pde_t *pgdir, uint sz)
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  for(i = 0; i < USERTOP; i += PGSIZE){
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    if(flags & PTE_S){
+      mem = P2V(pa);
+      kref(mem);
+    } else {
+      if((mem = kalloc()) == 0)
+        goto bad;
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    }
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
       goto bad;
@@ -359,6 +391,21 @@ uva2ka(pde_t *pgdir, char *uva)
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Like uva2ka, for a page the kernel may write through its own
+// mapping: a writable page that is not shared.  Such a write
+// leaves PTE_D clear, so writeback would miss it in a shared
+// file mapping.
+char*
+uva2kaw(pde_t *pgdir, char *uva)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, uva, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U|PTE_W|PTE_S)) != (PTE_P|PTE_U|PTE_W))
+    return 0;
+  return (char*)P2V(PTE_ADDR(*pte));
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
@@ -385,6 +432,420 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+//PAGEBREAK!
+// Find the vma of mm that contains address va, or 0.
+struct vma*
+vmalookup(struct mm *mm, uint va)
+{
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->end != 0 && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Fill in the page at va from mm's vma there, after it was touched
+// it (with a write if write is set).  Pages of shared vmas,
+// and read-only pages that are entirely file content, map the
+// page cache's copy, which is shared by every process mapping
+// that part of the file; other pages get a private copy.
+// Pages of anonymous vmas (no inode) are zero-filled.
+// Returns -1 if va is not in a vma that allows the access.
+// The caller must hold mm->lock.
+static int
+fillpage(struct mm *mm, uint va, int write)
+{
+  struct vma *v;
+  struct page *pg;
+  pte_t *pte;
+  char *mem;
+  uint a, n;
+
+  a = PGROUNDDOWN(va);
+  if((v = vmalookup(mm, a)) == 0)
+    return -1;
+  if(write && !(v->flags & VMA_WRITE))
+    return -1;
+  if((pte = walkpgdir(mm->pgdir, (char*)a, 1)) == 0)
+    return -1;
+  if(*pte & PTE_P)
+    return (write && !(*pte & PTE_W)) ? -1 : 0;
+
+  // Number of bytes of this page that come from the file.
+  n = 0;
+  if(a - v->start < v->filesz)
+    n = v->filesz - (a - v->start);
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  pg = 0;
+  if(n > 0){
+    ilock(v->ip);
+    pg = pageget(v->ip, v->off + (a - v->start));
+    iunlock(v->ip);
+    if(pg == 0)
+      return -1;
+  }
+  if(pg && ((v->flags & VMA_SHARED) ||
+            (!(v->flags & VMA_WRITE) && n == PGSIZE))){
+    kref(pg->data);
+    *pte = V2P(pg->data) | PTE_P | PTE_U | PTE_S;
+    if(v->flags & VMA_WRITE)
+      *pte |= PTE_W;
+  } else {
+    if((mem = kalloc()) == 0){
+      if(pg)
+        pageput(pg);
+      return -1;
+    }
+    if(n > 0)
+      memmove(mem, pg->data, n);
+    memset(mem + n, 0, PGSIZE - n);
+    *pte = V2P(mem) | PTE_P | PTE_U;
+    if(v->flags & VMA_WRITE)
+      *pte |= PTE_W;
+  }
+  if(pg)
+    pageput(pg);
+  return 0;
+}
+
+// Handle a page fault by p at va.
+int
+pagefault(struct proc *p, uint va, int write)
+{
+  int r;
+
+  acquiresleep(&p->mm->lock);
+  r = fillpage(p->mm, va, write);
+  releasesleep(&p->mm->lock);
+  return r;
+}
+
+// Make sure the n bytes of user memory at va are present, and
+// writable if write is set, faulting in pages of vmas as
+// needed, so that the kernel can use them directly without
+// faulting.  If other threads share p's memory, pin the range
+// so that they cannot unmap it until p's system call returns.
+// Returns -1 if they are not all user memory that allows the
+// access.
+int
+uvmtouch(struct proc *p, uint va, uint n, int write)
+{
+  struct mm *mm = p->mm;
+  pte_t *pte;
+  uint a;
+  int shared, r;
+
+  if(va + n < va || va + n > USERTOP)
+    return -1;
+  // Only p itself can add threads, so if it is alone now
+  // it stays alone and need not lock.
+  shared = mm->ref > 1;
+  if(shared)
+    acquiresleep(&mm->lock);
+  r = 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(mm->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P)){
+      if(fillpage(mm, a, write) < 0){
+        r = -1;
+        break;
+      }
+    } else if(!(*pte & PTE_U) || (write && !(*pte & PTE_W))){
+      r = -1;
+      break;
+    }
+  }
+  if(shared){
+    if(r == 0 && n > 0)
+      pin(p, PGROUNDDOWN(va), va + n);
+    releasesleep(&mm->lock);
+  }
+  return r;
+}
+
+// Release the n vmas at v.
+// Must be called inside a transaction, since it calls iput.
+void
+vmafree(struct vma *v, int n)
+{
+  for(; n > 0; v++, n--){
+    if(v->end != 0 && v->ip)
+      iput(v->ip);
+    v->end = 0;
+  }
+}
+
+// Return a vma of mm that overlaps [start, end), or 0.
+struct vma*
+vmaoverlap(struct mm *mm, uint start, uint end)
+{
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->end != 0 && v->start < end && start < v->end)
+      return v;
+  return 0;
+}
+
+// Allocate zeroed pages for [start, end) of mm,
+// marked to be shared with children.
+static int
+shareanon(struct mm *mm, uint start, uint end, int flags)
+{
+  char *mem;
+  uint a;
+  int perm;
+
+  perm = PTE_U | PTE_S;
+  if(flags & VMA_WRITE)
+    perm |= PTE_W;
+  for(a = start; a < end; a += PGSIZE){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(mappages(mm->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Map n bytes of ip starting at offset off into mm,
+// at the highest free addresses below USERTOP and above the
+// heap.  If ip is 0 the memory is anonymous and starts out
+// zeroed.  Shared anonymous memory is allocated now and
+// mapped PTE_S, so that fork shares the pages rather than
+// copying them and parent and child see each other's stores.
+// Returns the address, or -1.  The caller must hold mm->lock.
+int
+vmamap(struct mm *mm, struct inode *ip, uint off, uint n, int flags)
+{
+  struct vma *v, *u;
+  uint a;
+
+  n = PGROUNDUP(n);
+  if(n == 0 || n > USERTOP)
+    return -1;
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->end == 0)
+      break;
+  if(v == &mm->vma[NVMA])
+    return -1;
+
+  a = USERTOP - n;
+  while((u = vmaoverlap(mm, a, a + n)) != 0){
+    if(u->start < n)
+      return -1;
+    a = u->start - n;
+  }
+  if(a < PGROUNDUP(mm->sz))
+    return -1;
+
+  v->start = a;
+  v->end = a + n;
+  v->flags = flags;
+  v->ip = ip ? idup(ip) : 0;
+  v->off = off;
+  v->filesz = ip ? n : 0;
+  if(ip == 0 && (flags & VMA_SHARED) && shareanon(mm, a, a + n, flags) < 0){
+    vmaunmap(mm, a, a + n);
+    return -1;
+  }
+  return a;
+}
+
+// Write the pages in [start, end) of mm's shared vma v that
+// have been stored into back to the file.  Only the part of a page
+// before the end of the file is written: stores to a mapping
+// do not make the file bigger.
+static void
+writeback(struct mm *mm, struct vma *v, uint start, uint end)
+{
+  pte_t *pte;
+  uint a, off, n;
+
+  if((v->flags & (VMA_SHARED|VMA_WRITE)) != (VMA_SHARED|VMA_WRITE) ||
+     v->ip == 0)
+    return;
+  for(a = start; a < end; a += PGSIZE){
+    pte = walkpgdir(mm->pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & (PTE_P|PTE_D)) != (PTE_P|PTE_D))
+      continue;
+    off = v->off + (a - v->start);
+    begin_op();
+    ilock(v->ip);
+    if(off < v->ip->size){
+      n = v->ip->size - off;
+      if(n > PGSIZE)
+        n = PGSIZE;
+      writei(v->ip, P2V(PTE_ADDR(*pte)), off, n);
+    }
+    iunlock(v->ip);
+    end_op();
+    *pte &= ~PTE_D;
+  }
+}
+
+// Unmap [start, end) of mm wherever it is covered by vmas,
+// writing shared pages back to their files first.
+// Vmas partly in the range are cut; one that the range
+// splits in two needs a free vma.  Returns -1 if there is
+// none, before unmapping anything.  The caller must hold
+// mm->lock.
+int
+vmaunmap(struct mm *mm, uint start, uint end)
+{
+  struct vma *v, *w;
+  uint s, e;
+
+  start = PGROUNDDOWN(start);
+  end = PGROUNDUP(end);
+  if(end > USERTOP || start >= end)
+    return -1;
+
+  w = 0;
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->end == 0)
+      w = v;
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->end != 0 && v->start < start && end < v->end && w == 0)
+      return -1;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++){
+    if(v->end == 0 || v->end <= start || end <= v->start)
+      continue;
+    s = v->start > start ? v->start : start;
+    e = v->end < end ? v->end : end;
+    writeback(mm, v, s, e);
+    deallocuvm(mm->pgdir, e, s);
+
+    if(s == v->start && e == v->end){
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      v->end = 0;
+    } else if(s == v->start){
+      v->off += e - v->start;
+      v->filesz = v->filesz > e - v->start ? v->filesz - (e - v->start) : 0;
+      v->start = e;
+    } else if(e == v->end){
+      v->end = s;
+    } else {
+      // Split: w gets the part above the range.
+      *w = *v;
+      w->start = e;
+      w->off += e - v->start;
+      w->filesz = v->filesz > e - v->start ? v->filesz - (e - v->start) : 0;
+      if(w->ip)
+        idup(w->ip);
+      v->end = s;
+    }
+  }
+  tlbflush(mm);
+  return 0;
+}
+
+//PAGEBREAK!
+void
+mminit(void)
+{
+  struct mm *mm;
+
+  initlock(&mmtable.lock, "mmtable");
+  for(mm = mmtable.mm; mm < &mmtable.mm[NPROC]; mm++)
+    initsleeplock(&mm->lock, "mm");
+}
+
+// Allocate an empty address space with page table pgdir.
+struct mm*
+mmalloc(pde_t *pgdir)
+{
+  struct mm *mm;
+
+  acquire(&mmtable.lock);
+  for(mm = mmtable.mm; mm < &mmtable.mm[NPROC]; mm++){
+    if(mm->ref == 0){
+      mm->ref = 1;
+      release(&mmtable.lock);
+      mm->pgdir = pgdir;
+      mm->sz = 0;
+      mm->execer = 0;
+      memset(mm->vma, 0, sizeof(mm->vma));
+      return mm;
+    }
+  }
+  release(&mmtable.lock);
+  return 0;
+}
+
+// Allocate a copy of mm, for fork.
+struct mm*
+mmcopy(struct mm *mm)
+{
+  struct mm *nm;
+  struct vma *v;
+  pde_t *pgdir;
+
+  acquiresleep(&mm->lock);
+  if((pgdir = copyuvm(mm->pgdir)) == 0){
+    releasesleep(&mm->lock);
+    return 0;
+  }
+  if((nm = mmalloc(pgdir)) == 0){
+    releasesleep(&mm->lock);
+    freevm(pgdir);
+    return 0;
+  }
+  nm->sz = mm->sz;
+  memmove(nm->vma, mm->vma, sizeof(nm->vma));
+  for(v = nm->vma; v < &nm->vma[NVMA]; v++)
+    if(v->end != 0 && v->ip)
+      idup(v->ip);
+  releasesleep(&mm->lock);
+  return nm;
+}
+
+// Increment ref count for mm, for a new thread.
+struct mm*
+mmdup(struct mm *mm)
+{
+  acquire(&mmtable.lock);
+  mm->ref++;
+  release(&mmtable.lock);
+  return mm;
+}
+
+// Drop a thread's reference to mm.  The last one unmaps
+// everything, writing shared pages back to their files, and
+// frees the page table, so it must not be using it any more.
+void
+mmput(struct mm *mm)
+{
+  acquire(&mmtable.lock);
+  if(mm->ref > 1){
+    mm->ref--;
+    release(&mmtable.lock);
+    return;
+  }
+  release(&mmtable.lock);
+
+  acquiresleep(&mm->lock);
+  vmaunmap(mm, 0, USERTOP);
+  releasesleep(&mm->lock);
+  freevm(mm->pgdir);
+  mm->pgdir = 0;
+
+  acquire(&mmtable.lock);
+  mm->ref = 0;
+  release(&mmtable.lock);
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
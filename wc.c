@@ -1,23 +1,46 @@
+// Count lines, words and bytes.
+//   wc [-j n] [file ...]
+// With -j and more than one file, n forked workers count the
+// files at once, and the counts are printed in file order
+// (see forkeach in ulib.c).
+
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 
-char buf[512];
+#define CHUNK (64*1024)
+
+// Character classes, looked up for each byte.
+#define SPACE 1
+#define NL    2
+
+uchar ctype[256] = {
+  [' '] = SPACE, ['\r'] = SPACE, ['\t'] = SPACE, ['\v'] = SPACE,
+  ['\n'] = SPACE|NL,
+};
+
+char buf[CHUNK];
+
+struct counts {
+  int l, w, c;
+};
 
-void
-wc(int fd, char *name)
+// Count what is left of fd.  Returns -1 on a read error.
+int
+count(int fd, struct counts *ct)
 {
-  int i, n;
-  int l, w, c, inword;
+  int i, n, t, l, w, inword;
 
-  l = w = c = 0;
+  l = w = 0;
   inword = 0;
+  ct->c = 0;
   while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
+    ct->c += n;
+    for(i = 0; i < n; i++){
+      t = ctype[(uchar)buf[i]];
+      if(t & NL)
         l++;
-      if(strchr(" \r\t\n\v", buf[i]))
+      if(t & SPACE)
         inword = 0;
       else if(!inword){
         w++;
@@ -25,30 +48,60 @@ wc(int fd, char *name)
       }
     }
   }
-  if(n < 0){
-    printf(1, "wc: read error\n");
-    exit();
+  ct->l = l;
+  ct->w = w;
+  return n < 0 ? -1 : 0;
+}
+
+// Count file name and print its line.  Returns -1 after
+// printing the error.
+int
+wcfile(char *name)
+{
+  struct counts ct;
+  int fd, r;
+
+  if((fd = open(name, 0)) < 0){
+    printf(2, "wc: cannot open %s\n", name);
+    return -1;
   }
-  printf(1, "%d %d %d %s\n", l, w, c, name);
+  if((r = count(fd, &ct)) < 0)
+    printf(2, "wc: read error\n");
+  else
+    printf(1, "%d %d %d %s\n", ct.l, ct.w, ct.c, name);
+  close(fd);
+  return r;
 }
 
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int i, njob;
+  struct counts ct;
 
-  if(argc <= 1){
-    wc(0, "");
-    exit();
+  njob = 1;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-j") == 0){
+    njob = atoi(argv[2]);
+    i = 3;
   }
 
-  for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf(1, "wc: cannot open %s\n", argv[i]);
+  if(i >= argc){
+    if(count(0, &ct) < 0){
+      printf(2, "wc: read error\n");
       exit();
     }
-    wc(fd, argv[i]);
-    close(fd);
+    printf(1, "%d %d %d %s\n", ct.l, ct.w, ct.c, "");
+    exit();
   }
+  if(argc - i > 1 && njob > 1){
+    if(forkeach(argv + i, argc - i, njob, wcfile) < 0)
+      printf(2, "wc: cannot start worker\n");
+    exit();
+  }
+
+  for(; i < argc; i++)
+    if(wcfile(argv[i]) < 0)
+      exit();
   exit();
 }
@@ -57,6 +57,24 @@ stosl(void *addr, int data, int cnt)
                "memory", "cc");
 }
 
+static inline void
+movsb(void *dst, const void *src, int cnt)
+{
+  asm volatile("cld; rep movsb" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
+static inline void
+movsl(void *dst, const void *src, int cnt)
+{
+  asm volatile("cld; rep movsl" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
 struct segdesc;
 
 static inline void
@@ -117,6 +135,15 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until the next one arrives.
+// No interrupt is taken between the sti and the hlt, so one
+// that is already pending ends the halt instead of being missed.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt" : : : "memory");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +157,62 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add n to *addr and return the old value.
+static inline uint
+xaddl(volatile uint *addr, uint n)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "cc");
+  return n;
+}
+
+// Tell the processor that this is a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
+// Divide a 64-bit number by a 32-bit one.  The quotient must
+// fit in 32 bits, or the divl instruction faults.  (The kernel
+// is not linked with libgcc, which would do general 64-bit
+// division.)
+static inline uint
+divl(uint64 n, uint d)
+{
+  uint q, r;
+
+  asm("divl %4" : "=a" (q), "=d" (r) :
+      "a" ((uint)n), "d" ((uint)(n >> 32)), "rm" (d));
+  return q;
+}
+
+static inline void
+wrmsr(uint msr, uint val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+// Return the feature flags that cpuid leaf 1 reports in %edx.
+static inline uint
+cpufeatures(void)
+{
+  uint a, b, c, d;
+
+  asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return d;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -138,6 +221,14 @@ rcr2(void)
   return val;
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 static inline void
 lcr3(uint val)
 {